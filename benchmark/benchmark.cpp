@@ -5,11 +5,23 @@
  * * This script automates the execution of both parallel implementations 
  * across varying thread counts (1, 2, 4, 8) and aggregates the results 
  * into a formatted summary table for performance analysis.
+ * Both binaries share the kernels in ../src_common, so the OpenMP binary is
+ * also used to time the work-stealing backend on identical work.
+ *
+ * Usage: ./manager              thread scaling table (1, 2, 4, 8 threads)
+ *        ./manager schedules [N] schedule comparison table at N threads (default 4)
+ *        ./manager layouts [N]   interleaved vs planar pixel layout at N threads
+ *        ./manager pages [N]     4 KB vs huge pages, with and without pre-faulting
+ *        ./manager batch [N]     1, 2, 4 and 8 images per parallel region
+ *        ./manager processes [N] N threads in 1, 2 or 4 worker processes
+ *        ./manager mpi [N]       1, 2 and 4 MPI ranks of N threads: speedup and efficiency
+ *        ./manager daemon [N]    round trips to a warm daemon by path, file descriptor and raw memfd
  */
 
 #include <iostream>
 #include <vector>
 #include <string>
+#include <cstdio>
 #include <cstdlib>  
 #include <fstream>  
 #include <iomanip>  
@@ -28,6 +40,7 @@ struct Summary {
     int threads;
     string thrTime;
     string ompTime;
+    string stealTime;
 };
 
 // Improved helper to trim whitespace and carriage returns (important for Linux)
@@ -60,7 +73,188 @@ RunStats runAndGetStats(string cmd) {
     return stats;
 }
 
-int main() {
+// Runs the OpenMP binary once per variant (label, extra flags) and prints one table
+int compareVariants(const string& title, const string& column, const vector<pair<string, string>>& variants, int threads) {
+    vector<pair<string, RunStats>> results;
+
+    cout << "===========================================" << endl;
+    cout << "   " << title << " (" << threads << " threads)" << endl;
+    cout << "===========================================" << endl;
+
+    cout << "Compiling implementation..." << endl;
+    system("g++ ../src_openmp/main.cpp -o ../src_openmp/main_omp -fopenmp -pthread -std=c++17 -I../include");
+
+    for (const auto& v : variants) {
+        cout << "[" << column << "] " << v.first << " Running...:" << flush;
+        RunStats stats = runAndGetStats("../src_openmp/main_omp " + to_string(threads) + v.second);
+        cout << "Done! (Time: " << stats.time << ", Images: " << stats.count << ")" << endl;
+        results.push_back({v.first, stats});
+    }
+
+    cout << "\n+-------------+-----------------+--------+" << endl;
+    cout << "| " << left << setw(11) << column << " |  Time (s)       | Images |" << endl;
+    cout << "+-------------+-----------------+--------+" << endl;
+    for (const auto& r : results) {
+        cout << "| " << left << setw(11) << r.first
+             << " | " << setw(15) << r.second.time
+             << " | " << setw(6) << r.second.count << " |" << endl;
+    }
+    cout << "+-------------+-----------------+--------+" << endl;
+
+    system("rm temp_output.txt");
+    return 0;
+}
+
+// Runs the same pipeline under each schedule preset (see src_common/schedule.h)
+int compareSchedules(int threads) {
+    // Plain row kernels first as the reference, then every schedule
+    vector<pair<string, string>> variants = {{"(none)", ""}};
+    for (string s : {"rows", "tiles", "fused", "fused-vec"}) variants.push_back({s, " --schedule=" + s});
+    return compareVariants("SCHEDULE COMPARISON", "Schedule", variants, threads);
+}
+
+// Interleaved vs planar pixel layout (see src_common/planar.h), on the default
+// pipeline and on a stencil-heavy one where unit-stride planes matter most
+int compareLayouts(int threads) {
+    vector<pair<string, string>> variants;
+    for (string layout : {"interleaved", "planar"}) {
+        variants.push_back({layout, " --layout=" + layout});
+    }
+    for (string layout : {"interleaved", "planar"}) {
+        variants.push_back({layout.substr(0, 5) + "+stencil", " --layout=" + layout + " --pipeline=blur,blur,sharpen,edge"});
+    }
+    return compareVariants("LAYOUT COMPARISON", "Layout", variants, threads);
+}
+
+// Frame page size and pre-faulting (see src_common/pages.h) on a stencil-heavy pipeline
+int comparePages(int threads) {
+    vector<pair<string, string>> variants;
+    for (string pages : {"small", "thp", "hugetlb"}) {
+        variants.push_back({pages, " --pages=" + pages + " --no-prefault --pipeline=blur,blur,sharpen,edge"});
+        variants.push_back({pages + "+pf", " --pages=" + pages + " --pipeline=blur,blur,sharpen,edge"});
+    }
+    return compareVariants("PAGE SIZE COMPARISON", "Pages", variants, threads);
+}
+
+// Images sharing each step's parallel region (see executePlanBatch in src_common/pipeline.h)
+int compareBatching(int threads) {
+    vector<pair<string, string>> variants;
+    for (int k : {1, 2, 4, 8}) variants.push_back({"batch=" + to_string(k), " --batch=" + to_string(k)});
+    return compareVariants("BATCHING COMPARISON", "Batch", variants, threads);
+}
+
+// The same threads split between forked worker processes (see src_common/processes.h)
+int compareProcesses(int threads) {
+    vector<pair<string, string>> variants;
+    for (int p : {1, 2, 4}) variants.push_back({"processes=" + to_string(p), " --processes=" + to_string(p)});
+    return compareVariants("PROCESS COMPARISON", "Processes", variants, threads);
+}
+
+// MPI ranks of 'threads' threads each (see src_common/distributed.h); speedup and
+// efficiency are relative to one rank: efficiency = T(1) / (ranks x T(ranks))
+int compareRanks(int threads) {
+    cout << "===========================================" << endl;
+    cout << "   MPI RANK SCALING (" << threads << " threads per rank)" << endl;
+    cout << "===========================================" << endl;
+
+    cout << "Compiling implementation..." << endl;
+    system("mpicxx ../src_mpi/main.cpp -o ../src_mpi/main_mpi -fopenmp -std=c++17 -I../include");
+
+    vector<pair<int, RunStats>> results;
+    for (int ranks : {1, 2, 4}) {
+        cout << "[Ranks] " << ranks << " Running...:" << flush;
+        RunStats stats = runAndGetStats("mpirun --oversubscribe -np " + to_string(ranks) + " ../src_mpi/main_mpi " + to_string(threads));
+        cout << "Done! (Time: " << stats.time << ", Images: " << stats.count << ")" << endl;
+        results.push_back({ranks, stats});
+    }
+
+    double base = atof(results[0].second.time.c_str());
+    cout << "\n+-------+-----------------+--------+---------+------------+" << endl;
+    cout << "| Ranks |  Time (s)       | Images | Speedup | Efficiency |" << endl;
+    cout << "+-------+-----------------+--------+---------+------------+" << endl;
+    for (const auto& r : results) {
+        double t = atof(r.second.time.c_str());
+        double speedup = t > 0 ? base / t : 0;
+        char speedupText[16], efficiencyText[16];
+        snprintf(speedupText, sizeof(speedupText), "%.2f", speedup);
+        snprintf(efficiencyText, sizeof(efficiencyText), "%.1f%%", 100 * speedup / r.first);
+        cout << "| " << left << setw(5) << r.first
+             << " | " << setw(15) << r.second.time
+             << " | " << setw(6) << r.second.count
+             << " | " << setw(7) << speedupText
+             << " | " << setw(10) << efficiencyText << " |" << endl;
+    }
+    cout << "+-------+-----------------+--------+---------+------------+" << endl;
+
+    system("rm temp_output.txt");
+    return 0;
+}
+
+// Single-image round trips to a daemon of 'threads' threads (see src_common/daemon.h),
+// for each way a client can hand over the image; the last client stops the daemon
+int compareDaemon(int threads) {
+    const string socketPath = "/tmp/cst435-benchmark.sock";
+    cout << "===========================================" << endl;
+    cout << "   DAEMON ROUND TRIPS (" << threads << " threads)" << endl;
+    cout << "===========================================" << endl;
+
+    cout << "Compiling implementation..." << endl;
+    system("g++ ../src_openmp/main.cpp -o ../src_openmp/main_omp -fopenmp -pthread -std=c++17 -I../include");
+    system(("../src_openmp/main_omp " + to_string(threads) + " --daemon=" + socketPath + " > daemon_output.txt 2>&1 &").c_str());
+    system("sleep 1");
+
+    vector<pair<string, string>> variants = {{"path", ""}, {"file fd", " --client-fd=file"}, {"raw memfd", " --client-fd=raw --shutdown"}};
+    vector<pair<string, RunStats>> results;
+    for (const auto& v : variants) {
+        cout << "[Passing] " << v.first << " Running...:" << flush;
+        RunStats stats = runAndGetStats("../src_openmp/main_omp --client=" + socketPath + v.second);
+        // The client reports "Round trip: <mean> ms mean, ..." instead of a total time
+        ifstream file("temp_output.txt");
+        string line;
+        while (getline(file, line)) {
+            if (line.find("Round trip:") != string::npos) stats.time = cleanString(line.substr(line.find(":") + 1, line.find(" ms") - line.find(":") - 1));
+        }
+        cout << "Done! (Mean: " << stats.time << " ms, Images: " << stats.count << ")" << endl;
+        results.push_back({v.first, stats});
+    }
+
+    cout << "\n+-------------+-----------------+--------+" << endl;
+    cout << "| Passing     |  Round trip (ms)| Images |" << endl;
+    cout << "+-------------+-----------------+--------+" << endl;
+    for (const auto& r : results) {
+        cout << "| " << left << setw(11) << r.first
+             << " | " << setw(15) << r.second.time
+             << " | " << setw(6) << r.second.count << " |" << endl;
+    }
+    cout << "+-------------+-----------------+--------+" << endl;
+
+    system("rm temp_output.txt daemon_output.txt");
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "schedules") {
+        return compareSchedules(argc > 2 ? atoi(argv[2]) : 4);
+    }
+    if (argc > 1 && string(argv[1]) == "layouts") {
+        return compareLayouts(argc > 2 ? atoi(argv[2]) : 4);
+    }
+    if (argc > 1 && string(argv[1]) == "mpi") {
+        return compareRanks(argc > 2 ? atoi(argv[2]) : 1);
+    }
+    if (argc > 1 && string(argv[1]) == "processes") {
+        return compareProcesses(argc > 2 ? atoi(argv[2]) : 4);
+    }
+    if (argc > 1 && string(argv[1]) == "batch") {
+        return compareBatching(argc > 2 ? atoi(argv[2]) : 8);
+    }
+    if (argc > 1 && string(argv[1]) == "daemon") {
+        return compareDaemon(argc > 2 ? atoi(argv[2]) : 4);
+    }
+    if (argc > 1 && string(argv[1]) == "pages") {
+        return comparePages(argc > 2 ? atoi(argv[2]) : 4);
+    }
+
     vector<int> threadCounts = {1, 2, 4, 8};
     vector<Summary> summaryList;
 
@@ -71,12 +265,12 @@ int main() {
     /**
      * Compilation Phase
      * -fopenmp: Required for OpenMP directives
-     * -phthread: Required for C++ std::thread library
+     * -phthread: Required for C++ std::thread library (also the worker pool in ../src_common)
      * -I../include: Links the STB image headers
      */
     cout << "Compiling implementations..." << endl;
     system("g++ ../src_threads/main.cpp -o ../src_threads/main_thr -pthread -std=c++17 -I../include");
-    system("g++ ../src_openmp/main.cpp -o ../src_openmp/main_omp -fopenmp -std=c++17 -I../include");
+    system("g++ ../src_openmp/main.cpp -o ../src_openmp/main_omp -fopenmp -pthread -std=c++17 -I../include");
 
     // Benchmarking loop
     for (int t : threadCounts) {
@@ -90,25 +284,30 @@ int main() {
         cout << "\n[Test 2] OpenMP Running...:" << flush;
         RunStats omp = runAndGetStats("../src_openmp/main_omp " + to_string(t));
         cout << "Done! (Time: " << omp.time << ", Images: " << omp.count << ")" << endl;
+
+        cout << "\n[Test 3] Work-Stealing Running...:" << flush;
+        RunStats steal = runAndGetStats("../src_openmp/main_omp " + to_string(t) + " --backend=steal");
+        cout << "Done! (Time: " << steal.time << ", Images: " << steal.count << ")" << endl;
         cout << "-------------------------------------------" << endl;
 
-        summaryList.push_back({t, thr.time, omp.time});
+        summaryList.push_back({t, thr.time, omp.time, steal.time});
     }
 
     // --- FINAL SUMMARY TABLE ---
     cout << "\n\n===========================================" << endl;
     cout << "          FINAL PERFORMANCE SUMMARY" << endl;
     cout << "===========================================" << endl;
-    cout << "+----------+-----------------+-----------------+" << endl;
-    cout << "| Threads  | Std::Threads (s)|  OpenMP (s)     |" << endl;
-    cout << "+----------+-----------------+-----------------+" << endl;
+    cout << "+----------+-----------------+-----------------+-----------------+" << endl;
+    cout << "| Threads  | Std::Threads (s)|  OpenMP (s)     | Work-Steal (s)  |" << endl;
+    cout << "+----------+-----------------+-----------------+-----------------+" << endl;
 
     for (const auto& s : summaryList) {
         cout << "| " << left << setw(8) << s.threads 
              << " | " << setw(15) << s.thrTime 
-             << " | " << setw(15) << s.ompTime << " |" << endl;
+             << " | " << setw(15) << s.ompTime
+             << " | " << setw(15) << s.stealTime << " |" << endl;
     }
-    cout << "+----------+-----------------+-----------------+" << endl;
+    cout << "+----------+-----------------+-----------------+-----------------+" << endl;
     
     // Cleanup temporary files to leave the environment tidy
     system("rm temp_output.txt");
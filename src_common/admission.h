@@ -0,0 +1,259 @@
+/**
+ * @file admission.h
+ * @brief Memory-budget admission of images decoded ahead of the pipeline (--prefetch)
+ * @course CST435: Parallel Computing
+ *
+ * With --prefetch=N, N loader threads decode images while the workers run
+ * the pipeline on the current one, so peak memory grows with the number of
+ * images in flight. Every image's size is known from stbi_info before it is
+ * decoded, and a loader only starts on an image whose bytes fit in what is
+ * left of the budget:
+ *   - while decoding, an image commits twice its pixels (the decoder's
+ *     component planes plus the output), afterwards only its pixels
+ *   - the commitment is returned once the pipeline has finished with it
+ * The oldest waiting image goes first when it fits. When it does not, the
+ * smallest waiting image that fits is admitted instead, so the cores stay
+ * busy while a large image drains; after kMaxPassOver such overtakes nothing
+ * else is admitted until the large image fits, so it cannot starve.
+ * With an empty pipeline one image is always admitted, however large.
+ * Under --processes (processes.h) and MPI (distributed.h) the images are
+ * not a fixed list: each one is claimed from a WorkSource when the feed
+ * runs dry, and settled with it once it is done. So are they under --watch
+ * (watch.h), which runs without loader threads.
+ */
+
+#ifndef CST435_ADMISSION_H
+#define CST435_ADMISSION_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/stb_image.h"
+#include "arena.h"
+#include "runner.h"
+
+struct ImageInfo {
+    std::string path;
+    std::string filename;
+    int id = -1;                   // position in the scan (the work queue's index)
+    int width = 0, height = 0, channels = 0;
+    size_t bytes = 0;              // decoded size, width * height * channels
+    bool readable = false;         // stbi_info understood the header
+    std::shared_ptr<const std::vector<unsigned char>> encoded;   // set = decoded from memory, not 'path' (--stream)
+};
+
+struct LoadedImage {
+    ImageInfo info;
+    unsigned char* pixels = nullptr;   // nullptr = failed to decode
+};
+
+// ==========================================
+//              SHARED WORK SOURCES
+// ==========================================
+// How a claimed image ended (stored in the shared queue of processes.h)
+const int32_t kItemDone = -2;
+const int32_t kItemFailed = -3;    // could not be decoded or processed
+const int32_t kItemSkipped = -4;   // too large for the worker's frame buffers
+
+// Where one worker of a multi-process or multi-node run gets its images from.
+// The batch loop claims images one at a time and settles each claimed image.
+class WorkSource {
+public:
+    virtual ~WorkSource() = default;
+    virtual int index() const = 0;                              // worker number on this host (CPU placement)
+    virtual std::string tag() const = 0;                        // prefix of the worker's per-image lines
+    virtual bool standalone() const { return false; }           // true = the batch loop prints its own banner and report
+    virtual bool claim(ImageInfo& info) = 0;                    // false once no image is left (or for now, while images are held)
+    virtual void finish(const ImageInfo& info, int32_t state) = 0;
+    virtual void recordBusy(double seconds) = 0;                // wall time of one group of images
+    virtual bool takesResults() const { return false; }         // true = results go to putResult(), not --save
+    virtual void putResult(const ImageInfo&, const unsigned char*) {}
+};
+
+// Headers of every image in 'folder', in directory order (nothing is decoded).
+inline std::vector<ImageInfo> scanImages(const std::string& folder) {
+    std::vector<ImageInfo> images;
+    for (const auto& entry : std::filesystem::directory_iterator(folder)) {
+        ImageInfo info;
+        info.path = entry.path().string();
+        info.filename = entry.path().filename().string();
+        if (!isImageFile(info.path)) continue;
+        info.id = (int)images.size();
+        info.readable = stbi_info(info.path.c_str(), &info.width, &info.height, &info.channels) != 0;
+        if (info.readable) info.bytes = (size_t)info.width * info.height * info.channels;
+        images.push_back(info);
+    }
+    return images;
+}
+
+class ImageFeed {
+public:
+    static const int kMaxPassOver = 8;
+
+    // Fills in the next image to decode; false when there are no more.
+    using Claim = std::function<bool(ImageInfo&)>;
+
+    // 'budget' = bytes decoded images may commit (0 = unlimited);
+    // 'loaders' = background decoder threads (0 = decode on the caller's thread);
+    // 'claim' = where more images come from once 'images' are all taken (may be empty).
+    ImageFeed(std::vector<ImageInfo> images, size_t budget, int loaders, Claim claim = Claim())
+        : pending_(images.begin(), images.end()), claim_(claim), budget_(budget), ahead_(loaders) {
+        for (int i = 0; i < loaders; ++i) threads_.emplace_back([this] { loaderLoop(); });
+    }
+
+    ~ImageFeed() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        canAdmit_.notify_all();
+        for (auto& t : threads_) t.join();
+        for (auto& img : ready_) stbi_image_free(img.pixels);
+    }
+
+    // Next decoded image, in the order they finish decoding. False once every image was handed out.
+    // With 'wait' false it is also false when nothing is decoding and nothing pending fits the
+    // budget, i.e. until the caller releases images it holds.
+    bool next(LoadedImage& out, bool wait = true) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (threads_.empty()) {
+            int index = pickLocked();
+            if (index < 0) return false;
+            ImageInfo info = takeLocked(index);
+            lock.unlock();
+            out = decode(info);
+            lock.lock();
+            settleLocked(out);
+            return true;
+        }
+        hasReady_.wait(lock, [&] { return !ready_.empty() || (loading_ == 0 && (drainedLocked() || (!wait && !admissibleLocked()))); });
+        if (ready_.empty()) return false;
+        out = ready_.front();
+        ready_.pop_front();
+        canAdmit_.notify_all();
+        return true;
+    }
+
+    // Frees a handed-out image and returns its bytes to the budget.
+    void release(LoadedImage& img) {
+        if (!img.pixels) return;
+        stbi_image_free(img.pixels);
+        img.pixels = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            committed_ -= img.info.bytes;
+        }
+        canAdmit_.notify_all();
+    }
+
+    size_t peakCommitted() const { return peak_; }
+    int overtakes() const { return overtakes_; }
+
+private:
+    bool fitsLocked(size_t bytes) const {
+        return budget_ == 0 || committed_ == 0 || committed_ + bytes <= budget_;
+    }
+
+    // True when nothing is pending and the claim source (if any) has nothing more either.
+    bool drainedLocked() {
+        ImageInfo info;
+        if (pending_.empty() && claim_ && claim_(info)) pending_.push_back(info);
+        return pending_.empty();
+    }
+
+    // True if pickLocked() would admit a pending image now.
+    bool admissibleLocked() const {
+        if (pending_.empty()) return false;
+        if (fitsLocked(2 * pending_[0].bytes)) return true;
+        if (passedOver_ >= kMaxPassOver) return false;
+        for (const ImageInfo& info : pending_) {
+            if (fitsLocked(2 * info.bytes)) return true;
+        }
+        return false;
+    }
+
+    // Index of the pending image to admit now, or -1 to wait.
+    int pickLocked() {
+        if (drainedLocked()) return -1;
+        if (fitsLocked(2 * pending_[0].bytes)) { passedOver_ = 0; return 0; }
+        if (passedOver_ >= kMaxPassOver) return -1;
+        int best = -1;
+        for (int i = 1; i < (int)pending_.size(); ++i) {
+            if (fitsLocked(2 * pending_[i].bytes) && (best < 0 || pending_[i].bytes < pending_[best].bytes)) best = i;
+        }
+        if (best > 0) { passedOver_++; overtakes_++; }
+        return best;
+    }
+
+    ImageInfo takeLocked(int index) {
+        ImageInfo info = pending_[index];
+        pending_.erase(pending_.begin() + index);
+        committed_ += 2 * info.bytes;
+        peak_ = std::max(peak_, committed_);
+        loading_++;
+        return info;
+    }
+
+    // Decoding is done: keep only the pixels committed (nothing if it failed).
+    void settleLocked(const LoadedImage& img) {
+        loading_--;
+        committed_ -= img.pixels ? img.info.bytes : 2 * img.info.bytes;
+    }
+
+    static LoadedImage decode(const ImageInfo& info) {
+        LoadedImage img;
+        img.info = info;
+        if (!info.readable) return img;
+        int w, h, c;
+        img.pixels = info.encoded ? stbi_load_from_memory(info.encoded->data(), (int)info.encoded->size(), &w, &h, &c, 0)
+                                  : stbi_load(info.path.c_str(), &w, &h, &c, 0);
+        arenaImageDone();
+        if (img.pixels && (w != info.width || h != info.height || c != info.channels)) {
+            // The file changed since it was scanned
+            stbi_image_free(img.pixels);
+            img.pixels = nullptr;
+        }
+        return img;
+    }
+
+    void loaderLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_ && !drainedLocked()) {
+            int index = (int)ready_.size() + loading_ < ahead_ ? pickLocked() : -1;
+            if (index < 0) { canAdmit_.wait(lock); continue; }
+            ImageInfo info = takeLocked(index);
+            lock.unlock();
+            LoadedImage img = decode(info);
+            lock.lock();
+            settleLocked(img);
+            ready_.push_back(img);
+            hasReady_.notify_one();
+            canAdmit_.notify_all();
+        }
+        hasReady_.notify_all();
+    }
+
+    std::deque<ImageInfo> pending_;
+    Claim claim_;
+    std::deque<LoadedImage> ready_;
+    size_t budget_;
+    size_t committed_ = 0, peak_ = 0;
+    int ahead_;                        // at most this many images decoded or decoding ahead
+    int loading_ = 0;
+    int passedOver_ = 0;               // overtakes of the current oldest image
+    int overtakes_ = 0;
+    bool stop_ = false;
+    std::mutex mutex_;
+    std::condition_variable canAdmit_, hasReady_;
+    std::vector<std::thread> threads_;
+};
+
+#endif // CST435_ADMISSION_H
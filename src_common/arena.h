@@ -0,0 +1,183 @@
+/**
+ * @file arena.h
+ * @brief Per-thread bump arenas for stb_image's allocations (STBI_MALLOC hooks)
+ * @course CST435: Parallel Computing
+ *
+ * One decode makes dozens of STBI_MALLOC/STBI_REALLOC/STBI_FREE calls
+ * (component planes, line buffers, Huffman and zlib scratch, the output),
+ * and with several loader threads (--prefetch) they all contend on the
+ * global heap. Each main.cpp routes the hooks here before it includes the
+ * stb_image implementation:
+ *   - every thread bumps allocations out of its own kArenaChunkBytes chunks
+ *   - a chunk counts its live allocations; STBI_FREE (from any thread, the
+ *     decoded pixels are freed by the batch loop) only decrements that count
+ *   - after each image the thread leaves a chunk that still holds the
+ *     image's pixels, and a chunk whose allocations are all freed is
+ *     rewound and reused, so scratch memory is recycled image after image
+ *   - requests above kArenaMaxRequest, and chunks beyond kArenaMaxChunks
+ *     per thread, go to the system heap
+ * Growing the latest allocation of a chunk (zlib output, PNG IDAT) stays in
+ * place. arenaStats() reports where the allocations went.
+ */
+
+#ifndef CST435_ARENA_H
+#define CST435_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+const size_t kArenaChunkBytes = 8 * 1024 * 1024;
+const size_t kArenaMaxRequest = kArenaChunkBytes / 2;
+const size_t kArenaMaxChunks = 8;
+
+// refs = live allocations + 1 while a thread's arena owns the chunk; whoever drops
+// the last reference (the owner, or the thread freeing the last block) frees it.
+struct ArenaChunk {
+    std::atomic<int> refs{1};
+    size_t used = 0;               // bump offset into data
+    unsigned char* data = nullptr;
+
+    void unref() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::free(data);
+            delete this;
+        }
+    }
+    bool idle() const { return refs.load(std::memory_order_acquire) == 1; }
+};
+
+// Precedes every block handed to stb_image; 16 bytes keep the block 16-byte aligned.
+struct alignas(16) ArenaHeader {
+    ArenaChunk* chunk;             // nullptr = came from the system heap
+    size_t size;
+};
+
+struct ArenaStats {
+    std::atomic<uint64_t> arenaAllocs{0}, heapAllocs{0}, inPlaceGrows{0}, rewinds{0};
+    std::atomic<uint64_t> chunks{0}, arenaBytes{0}, heapBytes{0};
+};
+
+inline ArenaStats& arenaStats() {
+    static ArenaStats stats;
+    return stats;
+}
+
+class ThreadArena {
+public:
+    ~ThreadArena() {
+        // Chunks still holding pixels handed to another thread are freed with their last block
+        for (ArenaChunk* c : chunks_) c->unref();
+    }
+
+    void* allocate(size_t size) {
+        size_t need = sizeof(ArenaHeader) + ((size + 15) & ~(size_t)15);
+        if (size > kArenaMaxRequest) return heapBlock(size);
+        ArenaChunk* chunk = current_ && current_->used + need <= kArenaChunkBytes ? current_ : nextChunk();
+        if (!chunk) return heapBlock(size);
+        ArenaHeader* h = (ArenaHeader*)(chunk->data + chunk->used);
+        h->chunk = chunk;
+        h->size = size;
+        chunk->used += need;
+        chunk->refs.fetch_add(1, std::memory_order_relaxed);
+        last_ = h;
+        arenaStats().arenaAllocs.fetch_add(1, std::memory_order_relaxed);
+        arenaStats().arenaBytes.fetch_add(size, std::memory_order_relaxed);
+        return h + 1;
+    }
+
+    void* reallocate(void* p, size_t size) {
+        if (!p) return allocate(size);
+        ArenaHeader* h = (ArenaHeader*)p - 1;
+        // The thread's latest allocation can grow in place while its chunk has room
+        if (h == last_ && h->chunk == current_ && size <= kArenaMaxRequest) {
+            size_t end = (unsigned char*)p - current_->data + ((size + 15) & ~(size_t)15);
+            if (end <= kArenaChunkBytes) {
+                current_->used = std::max(current_->used, end);
+                h->size = size;
+                arenaStats().inPlaceGrows.fetch_add(1, std::memory_order_relaxed);
+                return p;
+            }
+        }
+        void* q = allocate(size);
+        if (q) std::memcpy(q, p, std::min(h->size, size));
+        release(p);
+        return q;
+    }
+
+    static void release(void* p) {
+        if (!p) return;
+        ArenaHeader* h = (ArenaHeader*)p - 1;
+        if (h->chunk) h->chunk->unref();
+        else std::free(h);
+    }
+
+    // An image is done: its pixels may still be live, so later images start in another chunk.
+    void imageDone() {
+        if (current_ && !current_->idle()) current_ = nullptr;
+        last_ = nullptr;
+    }
+
+private:
+    static void* heapBlock(size_t size) {
+        ArenaHeader* h = (ArenaHeader*)std::malloc(sizeof(ArenaHeader) + size);
+        if (!h) return nullptr;
+        h->chunk = nullptr;
+        h->size = size;
+        arenaStats().heapAllocs.fetch_add(1, std::memory_order_relaxed);
+        arenaStats().heapBytes.fetch_add(size, std::memory_order_relaxed);
+        return h + 1;
+    }
+
+    // A chunk with nothing live (rewound), or a new one; nullptr when the thread is at its limit.
+    ArenaChunk* nextChunk() {
+        last_ = nullptr;
+        for (ArenaChunk* c : chunks_) {
+            if (c->idle()) {
+                c->used = 0;
+                arenaStats().rewinds.fetch_add(1, std::memory_order_relaxed);
+                return current_ = c;
+            }
+        }
+        if (chunks_.size() >= kArenaMaxChunks) return current_ = nullptr;
+        unsigned char* data = (unsigned char*)std::aligned_alloc(64, kArenaChunkBytes);
+        if (!data) return current_ = nullptr;
+        ArenaChunk* chunk = new ArenaChunk;
+        chunk->data = data;
+        chunks_.push_back(chunk);
+        arenaStats().chunks.fetch_add(1, std::memory_order_relaxed);
+        return current_ = chunk;
+    }
+
+    std::vector<ArenaChunk*> chunks_;
+    ArenaChunk* current_ = nullptr;
+    ArenaHeader* last_ = nullptr;
+};
+
+inline ThreadArena& threadArena() {
+    thread_local ThreadArena arena;
+    return arena;
+}
+
+// The STBI_MALLOC / STBI_REALLOC(_SIZED) / STBI_FREE hooks.
+inline void* arenaMalloc(size_t size) { return threadArena().allocate(size); }
+inline void* arenaRealloc(void* p, size_t size) { return threadArena().reallocate(p, size); }
+inline void arenaFree(void* p) { ThreadArena::release(p); }
+inline void arenaImageDone() { threadArena().imageDone(); }
+
+inline std::string describeArenaStats() {
+    const ArenaStats& s = arenaStats();
+    std::ostringstream out;
+    out << s.arenaAllocs.load() << " arena / " << s.heapAllocs.load() << " heap allocations ("
+        << (s.arenaBytes.load() >> 20) << " / " << (s.heapBytes.load() >> 20) << " MB), "
+        << s.inPlaceGrows.load() << " grown in place, " << s.chunks.load() << " chunk(s) of "
+        << (kArenaChunkBytes >> 20) << " MB, " << s.rewinds.load() << " rewind(s)";
+    return out.str();
+}
+
+#endif // CST435_ARENA_H
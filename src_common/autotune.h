@@ -0,0 +1,263 @@
+/**
+ * @file autotune.h
+ * @brief Per-host search for the fastest thread count, backend and loop schedule
+ * @course CST435: Parallel Computing
+ *
+ * "./main --autotune" decodes a few sample images once and times the pipeline
+ * on them in-process under different execution settings:
+ *   1. thread count x backend, with the plain row kernels
+ *   2. for the winner: planar vs interleaved layout, tile DAG row heights,
+ *      schedule presets and a grid of tile sizes x vector widths x
+ *      (compute_root | compute_at tile)
+ * The best settings are saved as a small key=value profile named after a
+ * fingerprint of the host (CPU model, logical CPUs, cache sizes). When no
+ * execution settings are given on the command line, the batch processor
+ * loads the profile for the current host automatically.
+ */
+
+#ifndef CST435_AUTOTUNE_H
+#define CST435_AUTOTUNE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/stb_image.h"
+#include "executor.h"
+#include "resources.h"
+#include "runner.h"
+
+// ==========================================
+//              HOST FINGERPRINT
+// ==========================================
+// Human readable description of the things that change the best settings.
+inline std::string hostDescription() {
+    std::string model = "unknown-cpu";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) { model = trim(line.substr(line.find(':') + 1)); break; }
+    }
+
+    std::ostringstream out;
+    out << model << "; cpus=" << std::thread::hardware_concurrency();
+    for (int i = 0; i < 8; ++i) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i);
+        std::string size = readFirstLine(dir + "/size");
+        if (size.empty()) break;
+        out << "; L" << readFirstLine(dir + "/level") << readFirstLine(dir + "/type").substr(0, 1) << "=" << size;
+    }
+    return out.str();
+}
+
+// Stable hash of the description, used as the profile file name.
+inline std::string hostFingerprint(const std::string& description) {
+    return fnv1aHex(description);
+}
+
+// ==========================================
+//               TUNED PROFILE
+// ==========================================
+struct TunedProfile {
+    std::string host;                 // hostDescription() at tuning time
+    int numThreads = 1;
+    std::string backend;
+    std::string schedule;             // empty = plain row kernels
+    int dagTileRows = 0;
+    std::string layout = "interleaved";
+    double msPerImage = 0.0;
+};
+
+inline std::string profilePath(const std::string& dir) {
+    return dir + "/" + hostFingerprint(hostDescription()) + ".profile";
+}
+
+inline bool saveProfile(const std::string& path, const TunedProfile& p) {
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+    std::ofstream file(path);
+    if (!file) return false;
+    file << "# CST435 autotune profile\n"
+         << "host=" << p.host << "\n"
+         << "threads=" << p.numThreads << "\n"
+         << "backend=" << p.backend << "\n"
+         << "schedule=" << p.schedule << "\n"
+         << "dag=" << p.dagTileRows << "\n"
+         << "layout=" << p.layout << "\n"
+         << "ms_per_image=" << p.msPerImage << "\n";
+    return (bool)file;
+}
+
+inline bool loadProfile(const std::string& path, TunedProfile& p) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = line.substr(0, eq), value = line.substr(eq + 1);
+        if (key == "host") p.host = value;
+        else if (key == "threads") p.numThreads = std::max(1, std::atoi(value.c_str()));
+        else if (key == "backend") p.backend = value;
+        else if (key == "schedule") p.schedule = value;
+        else if (key == "dag") p.dagTileRows = std::max(0, std::atoi(value.c_str()));
+        else if (key == "layout") p.layout = value;
+        else if (key == "ms_per_image") p.msPerImage = std::atof(value.c_str());
+    }
+    return !p.backend.empty();
+}
+
+// ==========================================
+//                 AUTOTUNER
+// ==========================================
+struct SampleImage {
+    unsigned char* pixels;
+    int width, height, channels;
+};
+
+// Milliseconds per image for one configuration: best of 'repeats' passes over the samples.
+inline double timeConfiguration(const std::string& pipeline, const TunedProfile& cfg, const std::vector<SampleImage>& samples, int repeats) {
+    ExecutionMode mode;
+    std::string error;
+    if (!configureExecution(pipeline, cfg.schedule, cfg.dagTileRows, "", cfg.layout, "", mode, error)) return -1.0;
+    std::unique_ptr<Executor> exec = makeExecutor(cfg.backend, cfg.numThreads);
+    if (!exec) return -1.0;
+
+    size_t frameBytes = 0;
+    for (const auto& s : samples) frameBytes = std::max(frameBytes, (size_t)s.width * s.height * s.channels);
+    std::vector<unsigned char*> buffers(executionBuffers(mode), nullptr);
+    for (auto& b : buffers) {
+        b = allocateFrame(frameBytes);
+        if (!b) { for (auto* f : buffers) releaseFrame(f); return -1.0; }
+    }
+
+    double best = 1e30;
+    for (int r = 0; r <= repeats; ++r) {   // pass 0 warms up caches and thread pools
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const auto& s : samples) runImage(*exec, mode, s.pixels, buffers.data(), s.width, s.height, s.channels);
+        std::chrono::duration<double, std::milli> ms = std::chrono::high_resolution_clock::now() - start;
+        if (r > 0) best = std::min(best, ms.count() / samples.size());
+    }
+    for (auto* b : buffers) releaseFrame(b);
+    return best;
+}
+
+inline std::string describeConfiguration(const TunedProfile& cfg) {
+    std::ostringstream out;
+    out << cfg.numThreads << "T " << cfg.backend;
+    if (!cfg.schedule.empty()) out << " schedule=" << cfg.schedule;
+    if (cfg.dagTileRows > 0) out << " dag=" << cfg.dagTileRows;
+    if (cfg.layout != "interleaved") out << " layout=" << cfg.layout;
+    return out.str();
+}
+
+inline int runAutotune(const std::string& inputFolder, const std::string& pipeline, const std::string& profileDir, int sampleCount) {
+    namespace fs = std::filesystem;
+
+    std::cout << "===========================================" << std::endl;
+    std::cout << "   AUTOTUNE" << std::endl;
+    std::cout << "   Host: " << hostDescription() << std::endl;
+    std::cout << "===========================================" << std::endl;
+
+    if (!fs::exists(inputFolder)) {
+        std::cout << "Error: Input folder '" << inputFolder << "' not found." << std::endl;
+        return 1;
+    }
+
+    // Decode the samples once; only the pipeline is timed
+    std::vector<SampleImage> samples;
+    for (const auto& entry : fs::directory_iterator(inputFolder)) {
+        if ((int)samples.size() >= sampleCount) break;
+        std::string path = entry.path().string();
+        if (!isImageFile(path)) continue;
+        SampleImage s;
+        s.pixels = stbi_load(path.c_str(), &s.width, &s.height, &s.channels, 0);
+        if (s.pixels) samples.push_back(s);
+    }
+    if (samples.empty()) {
+        std::cout << "Error: No sample images could be loaded." << std::endl;
+        return 1;
+    }
+    std::cout << "Samples: " << samples.size() << " images" << std::endl;
+
+    const int repeats = 3;
+    TunedProfile best;
+    best.msPerImage = 1e30;
+    auto consider = [&](const TunedProfile& cfg) {
+        double ms = timeConfiguration(pipeline, cfg, samples, repeats);
+        if (ms < 0) return;
+        std::cout << "  " << std::left << std::setw(60) << describeConfiguration(cfg) << std::right << " "
+                  << std::fixed << std::setprecision(3) << ms << " ms/image" << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        if (ms < best.msPerImage) { best = cfg; best.msPerImage = ms; }
+    };
+
+    // 1. Thread count x backend with the plain row kernels
+    int hw = autoThreadCount(detectResourceLimits());
+    std::set<int> threadCounts = {1, 2, 4, hw, 2 * hw};
+    std::cout << "\n[1/2] Threads x backend" << std::endl;
+    for (int t : threadCounts) {
+        for (const auto& backend : availableBackends()) {
+            if (backend == "serial" && t != 1) continue;
+            TunedProfile cfg;
+            cfg.numThreads = t;
+            cfg.backend = backend;
+            consider(cfg);
+        }
+    }
+
+    // 2. Loop structure for the winning threads/backend
+    std::cout << "\n[2/2] Layout, tiling, vector width and fusion (" << best.numThreads << "T " << best.backend << ")" << std::endl;
+    TunedProfile base = best;
+    base.schedule.clear();
+    base.dagTileRows = 0;
+    base.layout = "interleaved";
+    {
+        TunedProfile cfg = base;
+        cfg.layout = "planar";
+        consider(cfg);
+    }
+    for (int rows : {16, 32, 64, 128}) {
+        TunedProfile cfg = base;
+        cfg.dagTileRows = rows;
+        consider(cfg);
+    }
+    for (const auto& preset : presetScheduleNames()) {
+        TunedProfile cfg = base;
+        cfg.schedule = preset;
+        consider(cfg);
+    }
+    for (const char* tile : {"0x8", "0x32", "64x16", "128x32", "256x32", "256x64"}) {
+        for (int vector : {1, 16}) {
+            for (bool fuse : {false, true}) {
+                TunedProfile cfg = base;
+                cfg.schedule = std::string("tile=") + tile + ",parallel=tiles,vector=" + std::to_string(vector) + (fuse ? ",fuse" : "");
+                consider(cfg);
+            }
+        }
+    }
+
+    for (auto& s : samples) stbi_image_free(s.pixels);
+
+    best.host = hostDescription();
+    std::string path = profilePath(profileDir);
+    std::cout << "\nBest: " << describeConfiguration(best) << " (" << best.msPerImage << " ms/image)" << std::endl;
+    if (!saveProfile(path, best)) {
+        std::cout << "Error: Could not write profile '" << path << "'" << std::endl;
+        return 1;
+    }
+    std::cout << "Saved profile: " << path << std::endl;
+    return 0;
+}
+
+#endif // CST435_AUTOTUNE_H
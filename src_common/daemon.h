@@ -0,0 +1,684 @@
+/**
+ * @file daemon.h
+ * @brief Long-running image service on a Unix socket (--daemon / --client)
+ * @course CST435: Parallel Computing
+ *
+ * A batch run pays for its setup before the first image: the worker pool is
+ * started, the plan compiled, the frame buffers allocated and faulted in, and
+ * the decoder arena grown. For one small image that setup costs more than
+ * the image itself. The daemon pays it once and keeps everything warm, so a
+ * request only costs its decode, the pipeline and handing the result back:
+ *   - an image can arrive by path, or as a descriptor passed over the socket
+ *     (SCM_RIGHTS): an encoded file, or a memfd holding raw pixels that the
+ *     pipeline reads in place, without a decode or a copy
+ *   - a request that came as a descriptor gets its result back as a memfd
+ *     of raw pixels
+ *
+ * One small image cannot keep every core busy, so requests are collected
+ * into micro-batches that share each step's parallel region (like --batch in
+ * the batch loop). Every connection belongs to a lane, interactive (the
+ * default) or bulk, and each lane queues its requests in arrival order:
+ *   - a lane's micro-batch is due once it holds --batch requests, or its
+ *     oldest request has waited --batch-window milliseconds
+ *   - images of a micro-batch are packed into the frame buffers; one that no
+ *     longer fits waits at the front of its lane for the next batch
+ *   - bulk batches run only while no interactive request is queued, except
+ *     after kMaxInteractiveRun interactive batches in a row, so bulk work
+ *     cannot starve
+ * Each lane reports its queue depth and its p50/p99 latency (from the request
+ * line arriving to the reply being sent) over the last kLatencySamples
+ * requests.
+ *
+ * The protocol is one line per request, fields separated by tabs so paths
+ * may contain spaces:
+ *   PROCESS input [output]          -> OK width height channels decodeUs pipelineUs outputUs
+ *                                      (writes the result as JPEG to 'output', if given)
+ *   PROCESS_FD [RAW width height channels], with one descriptor
+ *                                   -> OK width height channels decodeUs pipelineUs outputUs,
+ *                                      with the result memfd (width * height * channels bytes)
+ *   LANE interactive|bulk           -> OK (the lane of this connection's later requests)
+ *   STATS                           -> STATS key=value ... (counts, mean phases, per-lane depth and latency)
+ *   SHUTDOWN                        -> BYE, and the daemon exits
+ * A request that fails is answered with ERROR and the reason. Images are
+ * answered in the order they were sent on their connection; LANE, STATS and
+ * SHUTDOWN are answered at once. Requests still queued for a connection
+ * that closes are dropped.
+ */
+
+#ifndef CST435_DAEMON_H
+#define CST435_DAEMON_H
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../include/stb_image.h"
+#include "../include/stb_image_write.h"
+#include "admission.h"
+#include "arena.h"
+#include "runner.h"
+#include "sockets.h"
+
+const int kLaneInteractive = 0;
+const int kLaneBulk = 1;
+const int kLaneCount = 2;
+const int kMaxInteractiveRun = 4;      // interactive batches in a row before waiting bulk work goes
+const size_t kLatencySamples = 4096;   // per lane, for p50/p99
+
+using DaemonClock = std::chrono::high_resolution_clock;
+
+inline long elapsedMicros(DaemonClock::time_point from, DaemonClock::time_point to) {
+    return (long)std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+inline const char* laneName(int lane) {
+    return lane == kLaneBulk ? "bulk" : "interactive";
+}
+
+// Tab-separated fields of a request line.
+inline std::vector<std::string> splitFields(const std::string& line) {
+    std::vector<std::string> fields;
+    std::string field;
+    std::istringstream in(line);
+    while (std::getline(in, field, '\t')) fields.push_back(field);
+    return fields;
+}
+
+// The 'p' quantile (0..1) of 'samples', 0 when there are none.
+inline long percentile(std::vector<long> samples, double p) {
+    if (samples.empty()) return 0;
+    size_t k = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+// Set from SIGINT/SIGTERM; the serve loop stops at its next wake-up.
+inline volatile sig_atomic_t& daemonStopRequested() {
+    static volatile sig_atomic_t stop = 0;
+    return stop;
+}
+
+// A read-only mapping of a passed descriptor (a memfd or a regular file).
+struct MappedInput {
+    unsigned char* data = nullptr;
+    size_t size = 0;
+
+    MappedInput() = default;
+    MappedInput(const MappedInput&) = delete;
+    MappedInput& operator=(const MappedInput&) = delete;
+    ~MappedInput() { if (data) munmap(data, size); }
+
+    bool map(int fd, std::string& error) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            error = "Passed descriptor is empty or not a file";
+            return false;
+        }
+        size = (size_t)st.st_size;
+        void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            error = std::string("Cannot map passed descriptor: ") + std::strerror(errno);
+            return false;
+        }
+        data = (unsigned char*)p;
+        return true;
+    }
+};
+
+// ==========================================
+//               REQUEST LANES
+// ==========================================
+struct DaemonRequest {
+    LineSocket* client = nullptr;
+    std::vector<std::string> fields;   // the request line
+    int fd = -1;                       // descriptor of a PROCESS_FD, owned until the reply
+    DaemonClock::time_point arrived;
+};
+
+struct DaemonLane {
+    std::deque<DaemonRequest> queue;
+    std::vector<long> latencies;       // ring of the last kLatencySamples, microseconds
+    size_t nextSample = 0;
+    long served = 0;
+    size_t peakDepth = 0;
+
+    void recordLatency(long micros) {
+        if (latencies.size() < kLatencySamples) latencies.push_back(micros);
+        else latencies[nextSample] = micros;
+        nextSample = (nextSample + 1) % kLatencySamples;
+        served++;
+    }
+};
+
+// One request of a micro-batch, from its probed size to its reply.
+struct DaemonJob {
+    DaemonRequest request;
+    MappedInput input;                 // PROCESS_FD: the passed descriptor
+    unsigned char* decoded = nullptr;  // stb_image output, when the daemon decoded
+    const unsigned char* pixels = nullptr;
+    int width = 0, height = 0, channels = 0;
+    long decodeUs = 0;
+    std::string error;                 // set = answered with ERROR
+};
+
+// ==========================================
+//                 IMAGE DAEMON
+// ==========================================
+class ImageDaemon {
+public:
+    // 'buffers' of 'bufferSize' bytes each are the warm frame buffers every micro-batch reuses;
+    // up to 'maxBatch' requests are collected for at most 'windowMillis'.
+    ImageDaemon(Executor& exec, const ExecutionMode& mode, const std::vector<unsigned char*>& buffers, size_t bufferSize,
+                int maxBatch, double windowMillis)
+        : exec_(exec), mode_(mode), buffers_(buffers), bufferSize_(bufferSize), maxBatch_(std::max(1, maxBatch)),
+          window_(std::chrono::duration_cast<DaemonClock::duration>(std::chrono::duration<double, std::milli>(std::max(0.0, windowMillis)))) {}
+
+    ~ImageDaemon() {
+        for (DaemonLane& lane : lanes_) {
+            for (DaemonRequest& r : lane.queue) if (r.fd >= 0) ::close(r.fd);
+        }
+        if (listenFd_ >= 0) {
+            ::close(listenFd_);
+            unlink(path_.c_str());
+        }
+    }
+
+    bool listen(const std::string& path, std::string& error) {
+        listenFd_ = listenUnix(path, error);
+        path_ = path;
+        return listenFd_ >= 0;
+    }
+
+    // Serves requests until SHUTDOWN, SIGINT or SIGTERM.
+    void serve() {
+        struct sigaction action = {};
+        action.sa_handler = [](int) { daemonStopRequested() = 1; };
+        sigaction(SIGINT, &action, nullptr);     // no SA_RESTART: poll() returns EINTR
+        sigaction(SIGTERM, &action, nullptr);
+
+        while (!stop_ && !daemonStopRequested()) {
+            std::vector<pollfd> fds(1 + connections_.size());
+            fds[0] = { listenFd_, POLLIN, 0 };
+            for (size_t i = 0; i < connections_.size(); ++i) fds[1 + i] = { connections_[i].socket->fd(), POLLIN, 0 };
+            if (poll(fds.data(), fds.size(), pollTimeout(DaemonClock::now())) < 0) continue;
+
+            for (size_t i = 0; i < connections_.size() && !stop_; ++i) {
+                if (!fds[1 + i].revents) continue;
+                Connection& c = connections_[i];
+                if (!c.socket->fill()) { dropConnection(c); continue; }
+                std::string line;
+                while (!stop_ && c.socket->nextLine(line)) receive(c, line);
+            }
+            connections_.erase(std::remove_if(connections_.begin(), connections_.end(), [](const Connection& c) { return !c.socket->isOpen(); }),
+                               connections_.end());
+            if (fds[0].revents & POLLIN) {
+                int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0) connections_.push_back({ std::unique_ptr<LineSocket>(new LineSocket(fd)), kLaneInteractive });
+            }
+
+            // One micro-batch per pass, so requests that arrived meanwhile are queued before the next
+            int lane = stop_ ? -1 : pickLane(DaemonClock::now());
+            if (lane >= 0) runMicroBatch(lane);
+        }
+    }
+
+    long requests() const { return requests_; }
+    long failures() const { return failures_; }
+    long batches() const { return batches_; }
+    double meanBatch() const { return batches_ ? (double)batchedImages_ / batches_ : 0.0; }
+    // Mean microseconds per successful request spent decoding, in the pipeline (its whole batch) and on the output.
+    double meanDecode() const { return done() ? (double)decodeMicros_ / done() : 0.0; }
+    double meanPipeline() const { return done() ? (double)pipelineMicros_ / done() : 0.0; }
+    double meanOutput() const { return done() ? (double)outputMicros_ / done() : 0.0; }
+    const DaemonLane& lane(int index) const { return lanes_[index]; }
+
+private:
+    struct Connection {
+        std::unique_ptr<LineSocket> socket;
+        int lane;
+    };
+
+    long done() const { return requests_ - failures_; }
+
+    // A request line: images are queued on the connection's lane, the rest is answered at once.
+    void receive(Connection& c, const std::string& line) {
+        std::vector<std::string> fields = splitFields(line);
+        if (fields.empty()) return;
+        const std::string& command = fields[0];
+        if (command == "PROCESS" || command == "PROCESS_FD") {
+            DaemonRequest request;
+            request.client = c.socket.get();
+            request.fields = fields;
+            request.fd = command == "PROCESS_FD" ? c.socket->takeFd() : -1;
+            request.arrived = DaemonClock::now();
+            DaemonLane& lane = lanes_[c.lane];
+            lane.queue.push_back(request);
+            lane.peakDepth = std::max(lane.peakDepth, lane.queue.size());
+        } else if (command == "LANE" && fields.size() == 2 && (fields[1] == "interactive" || fields[1] == "bulk")) {
+            c.lane = fields[1] == "bulk" ? kLaneBulk : kLaneInteractive;
+            c.socket->sendLine("OK");
+        } else if (command == "STATS") {
+            c.socket->sendLine(describeStats());
+        } else if (command == "SHUTDOWN") {
+            c.socket->sendLine("BYE");
+            stop_ = true;
+        } else {
+            c.socket->sendLine("ERROR Unknown request '" + command + "'");
+        }
+    }
+
+    // A closed connection's queued requests are dropped with it.
+    void dropConnection(Connection& c) {
+        for (DaemonLane& lane : lanes_) {
+            for (DaemonRequest& r : lane.queue) {
+                if (r.client == c.socket.get() && r.fd >= 0) { ::close(r.fd); r.fd = -1; }
+            }
+            lane.queue.erase(std::remove_if(lane.queue.begin(), lane.queue.end(), [&](const DaemonRequest& r) { return r.client == c.socket.get(); }),
+                             lane.queue.end());
+        }
+        c.socket->close();
+    }
+
+    std::string describeStats() const {
+        std::ostringstream out;
+        out << "STATS requests=" << requests_ << " failed=" << failures_ << " batches=" << batches_
+            << " images_per_batch=" << meanBatch() << " decode_us=" << (long)meanDecode()
+            << " pipeline_us=" << (long)meanPipeline() << " output_us=" << (long)meanOutput();
+        for (int l = 0; l < kLaneCount; ++l) {
+            const DaemonLane& lane = lanes_[l];
+            out << " " << laneName(l) << "_depth=" << lane.queue.size() << " " << laneName(l) << "_peak=" << lane.peakDepth
+                << " " << laneName(l) << "_served=" << lane.served << " " << laneName(l) << "_p50_us=" << percentile(lane.latencies, 0.50)
+                << " " << laneName(l) << "_p99_us=" << percentile(lane.latencies, 0.99);
+        }
+        return out.str();
+    }
+
+    bool due(int lane, DaemonClock::time_point now) const {
+        const std::deque<DaemonRequest>& queue = lanes_[lane].queue;
+        return !queue.empty() && ((int)queue.size() >= maxBatch_ || now - queue.front().arrived >= window_);
+    }
+
+    // The lane whose micro-batch runs now, or -1.
+    int pickLane(DaemonClock::time_point now) const {
+        if (due(kLaneBulk, now) && (lanes_[kLaneInteractive].queue.empty() || interactiveRun_ >= kMaxInteractiveRun)) return kLaneBulk;
+        if (due(kLaneInteractive, now)) return kLaneInteractive;
+        return -1;
+    }
+
+    // Milliseconds poll() may sleep before a lane's window runs out (-1 = until a request arrives).
+    int pollTimeout(DaemonClock::time_point now) const {
+        if (pickLane(now) >= 0) return 0;
+        int timeout = -1;
+        for (const DaemonLane& lane : lanes_) {
+            if (lane.queue.empty()) continue;
+            DaemonClock::duration left = lane.queue.front().arrived + window_ - now;
+            if (left <= DaemonClock::duration::zero()) continue;   // due, but waiting for the other lane
+            int millis = (int)std::ceil(std::chrono::duration<double, std::milli>(left).count());
+            timeout = timeout < 0 ? millis : std::min(timeout, millis);
+        }
+        return timeout;
+    }
+
+    bool fits(int width, int height, int channels, std::string& error) const {
+        if (width > 0 && height > 0 && channels > 0 && (size_t)width * height * channels <= bufferSize_) return true;
+        error = "Image of " + std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(channels)
+              + " does not fit the pipeline buffers";
+        return false;
+    }
+
+    // The image's size, without decoding it (a passed descriptor is mapped).
+    bool probe(DaemonJob& job) {
+        const std::vector<std::string>& f = job.request.fields;
+        if (f[0] == "PROCESS") {
+            if (f.size() < 2 || f.size() > 3) {
+                job.error = "PROCESS needs an input path and optionally an output path";
+                return false;
+            }
+            if (!stbi_info(f[1].c_str(), &job.width, &job.height, &job.channels)) {
+                job.error = "Cannot read image '" + f[1] + "'";
+                return false;
+            }
+            return fits(job.width, job.height, job.channels, job.error);
+        }
+        bool raw = f.size() == 5 && f[1] == "RAW";
+        if (f.size() != 1 && !raw) {
+            job.error = "PROCESS_FD takes no fields, or RAW width height channels";
+            return false;
+        }
+        if (job.request.fd < 0) {
+            job.error = "PROCESS_FD came without a descriptor";
+            return false;
+        }
+        if (!job.input.map(job.request.fd, job.error)) return false;
+        if (raw) {
+            job.width = std::atoi(f[2].c_str());
+            job.height = std::atoi(f[3].c_str());
+            job.channels = std::atoi(f[4].c_str());
+            if (!fits(job.width, job.height, job.channels, job.error)) return false;
+            if (job.input.size < (size_t)job.width * job.height * job.channels) {
+                job.error = "Passed memfd holds " + std::to_string(job.input.size) + " bytes, less than the image";
+                return false;
+            }
+            return true;
+        }
+        if (!stbi_info_from_memory(job.input.data, (int)job.input.size, &job.width, &job.height, &job.channels)) {
+            job.error = "Passed descriptor is not a readable image";
+            return false;
+        }
+        return fits(job.width, job.height, job.channels, job.error);
+    }
+
+    // Decodes the image, or points at the raw pixels in place (no plan writes into its source image).
+    bool load(DaemonJob& job) {
+        auto start = DaemonClock::now();
+        const std::vector<std::string>& f = job.request.fields;
+        int w = 0, h = 0, c = 0;
+        if (f[0] == "PROCESS_FD" && f.size() == 5) {
+            job.pixels = job.input.data;
+        } else {
+            job.decoded = f[0] == "PROCESS" ? stbi_load(f[1].c_str(), &w, &h, &c, 0)
+                                            : stbi_load_from_memory(job.input.data, (int)job.input.size, &w, &h, &c, 0);
+            arenaImageDone();
+            if (!job.decoded || w != job.width || h != job.height || c != job.channels) {
+                // Unreadable, or the file changed since it was probed
+                job.error = f[0] == "PROCESS" ? "Failed to load '" + f[1] + "'" : "Failed to decode the passed image";
+                return false;
+            }
+            job.pixels = job.decoded;
+        }
+        job.decodeUs = elapsedMicros(start, DaemonClock::now());
+        return true;
+    }
+
+    // Runs up to maxBatch_ requests from the front of 'lane' as one micro-batch and answers them in order.
+    void runMicroBatch(int lane) {
+        DaemonLane& queue = lanes_[lane];
+        if (lane == kLaneBulk) interactiveRun_ = 0;
+        else if (!lanes_[kLaneBulk].queue.empty()) interactiveRun_++;
+
+        std::deque<DaemonJob> jobs;
+        std::vector<DaemonJob*> running;
+        size_t packed = 0;
+        while (!queue.queue.empty() && (int)jobs.size() < maxBatch_) {
+            DaemonJob& job = jobs.emplace_back();
+            job.request = queue.queue.front();
+            if (probe(job)) {
+                size_t bytes = ((size_t)job.width * job.height * job.channels + kPageBytes - 1) / kPageBytes * kPageBytes;
+                if (packed > 0 && packed + bytes > bufferSize_) {
+                    // Waits at the front of its lane for the next micro-batch
+                    jobs.pop_back();
+                    break;
+                }
+                if (load(job)) {
+                    packed += bytes;
+                    running.push_back(&job);
+                }
+            }
+            queue.queue.pop_front();
+        }
+
+        std::vector<BatchImage> batch(running.size());
+        size_t offset = 0;
+        for (size_t i = 0; i < running.size(); ++i) {
+            const DaemonJob& job = *running[i];
+            batch[i].img = job.pixels;
+            batch[i].width = job.width; batch[i].height = job.height; batch[i].channels = job.channels;
+            for (auto* buf : buffers_) batch[i].buffers.push_back(buf + offset);
+            offset += ((size_t)job.width * job.height * job.channels + kPageBytes - 1) / kPageBytes * kPageBytes;
+        }
+        auto start = DaemonClock::now();
+        if (!batch.empty()) {
+            runImageBatch(exec_, mode_, batch);
+            batches_++;
+            batchedImages_ += (long)batch.size();
+        }
+        long pipelineUs = elapsedMicros(start, DaemonClock::now());
+
+        size_t next = 0;
+        for (DaemonJob& job : jobs) {
+            const unsigned char* result = nullptr;
+            if (next < running.size() && running[next] == &job) {
+                result = batch[next++].result;
+                if (!result) job.error = "Memory allocation failed";
+            }
+            reply(lane, job, result, pipelineUs);
+            stbi_image_free(job.decoded);
+            if (job.request.fd >= 0) ::close(job.request.fd);
+        }
+    }
+
+    // Hands the result back (JPEG by path, or a memfd) and answers the request.
+    void reply(int lane, DaemonJob& job, const unsigned char* result, long pipelineUs) {
+        requests_++;
+        auto start = DaemonClock::now();
+        const std::vector<std::string>& f = job.request.fields;
+        int resultFd = -1;
+        if (job.error.empty()) {
+            if (f[0] == "PROCESS") {
+                if (f.size() == 3 && !stbi_write_jpg(f[2].c_str(), job.width, job.height, job.channels, result, 100)) job.error = "Cannot write '" + f[2] + "'";
+            } else {
+                resultFd = resultMemfd(result, (size_t)job.width * job.height * job.channels);
+                if (resultFd < 0) job.error = std::string("Cannot create the result memfd: ") + std::strerror(errno);
+            }
+        }
+        if (!job.error.empty()) {
+            failures_++;
+            job.request.client->sendLine("ERROR " + job.error);
+        } else {
+            long outputUs = elapsedMicros(start, DaemonClock::now());
+            decodeMicros_ += job.decodeUs;
+            pipelineMicros_ += pipelineUs;
+            outputMicros_ += outputUs;
+            std::ostringstream out;
+            out << "OK " << job.width << " " << job.height << " " << job.channels << " " << job.decodeUs << " " << pipelineUs << " " << outputUs;
+            job.request.client->sendLine(out.str(), resultFd);
+            if (resultFd >= 0) ::close(resultFd);
+        }
+        lanes_[lane].recordLatency(elapsedMicros(job.request.arrived, DaemonClock::now()));
+    }
+
+    // A memfd holding a copy of the result (the frame buffers are reused by the next micro-batch).
+    static int resultMemfd(const unsigned char* result, size_t bytes) {
+        int fd = memfd_create("cst435-result", MFD_CLOEXEC);
+        if (fd < 0) return -1;
+        void* p = ftruncate(fd, (off_t)bytes) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            return -1;
+        }
+        std::memcpy(p, result, bytes);
+        munmap(p, bytes);
+        return fd;
+    }
+
+    Executor& exec_;
+    const ExecutionMode& mode_;
+    std::vector<unsigned char*> buffers_;
+    size_t bufferSize_;
+    int maxBatch_;
+    DaemonClock::duration window_;
+    int listenFd_ = -1;
+    std::string path_;
+    bool stop_ = false;
+    std::vector<Connection> connections_;
+    DaemonLane lanes_[kLaneCount];
+    int interactiveRun_ = 0;           // interactive batches run in a row while bulk work waited
+    long requests_ = 0, failures_ = 0;
+    long batches_ = 0, batchedImages_ = 0;
+    long decodeMicros_ = 0, pipelineMicros_ = 0, outputMicros_ = 0;
+};
+
+// ==========================================
+//                DAEMON CLIENT
+// ==========================================
+// Sends every image of 'inputFolder' to the daemon at 'socketPath' on 'lane' and reports the round trips.
+// 'passFd': "" = by path, "file" = the open file's descriptor, "raw" = decoded here into a memfd.
+// Up to 'inFlight' requests are outstanding at a time, so the daemon can batch them.
+// With 'save' the results are written to 'outputFolder' (by the daemon when sent by path).
+inline int runDaemonClient(const std::string& socketPath, const std::string& inputFolder, const std::string& outputFolder,
+                           bool save, const std::string& passFd, const std::string& lane, int inFlight, bool shutdown) {
+    namespace fs = std::filesystem;
+
+    if (passFd != "" && passFd != "file" && passFd != "raw") {
+        std::cout << "Error: Unknown --client-fd mode '" << passFd << "' (use raw or file)" << std::endl;
+        return 1;
+    }
+    if (lane != "interactive" && lane != "bulk") {
+        std::cout << "Error: Unknown --lane '" << lane << "' (use interactive or bulk)" << std::endl;
+        return 1;
+    }
+    if (!fs::exists(inputFolder)) {
+        std::cout << "Error: Input folder '" << inputFolder << "' not found." << std::endl;
+        return 1;
+    }
+    LineSocket daemon;
+    std::string error, reply;
+    if (!daemon.connectUnix(socketPath, error)) {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+    if (!daemon.sendLine("LANE\t" + lane) || !daemon.readLine(reply) || reply != "OK") {
+        std::cout << "Error: Daemon refused the " << lane << " lane" << std::endl;
+        return 1;
+    }
+    if (save && !fs::exists(outputFolder)) fs::create_directories(outputFolder);
+    inFlight = std::max(1, inFlight);
+
+    std::cout << "===========================================" << std::endl;
+    std::cout << "   DAEMON CLIENT (" << socketPath << ", " << lane << " lane)" << std::endl;
+    std::cout << "   Images sent " << (passFd == "raw" ? "as raw pixels in a memfd" : passFd == "file" ? "as open file descriptors" : "by path")
+              << ", up to " << inFlight << " in flight" << std::endl;
+    std::cout << "===========================================" << std::endl;
+
+    struct Sent {
+        std::string filename, outPath;
+        DaemonClock::time_point start;
+    };
+    std::vector<ImageInfo> images = scanImages(inputFolder);
+    std::deque<Sent> outstanding;
+    size_t nextImage = 0;
+    int done = 0, failed = 0;
+    std::vector<long> latencies;
+    long phases[3] = {0, 0, 0};
+    auto start = DaemonClock::now();
+    while (nextImage < images.size() || !outstanding.empty()) {
+        // Keep up to inFlight requests outstanding; each is prepared (any decoding done) before its clock starts
+        while (nextImage < images.size() && (int)outstanding.size() < inFlight) {
+            const ImageInfo& info = images[nextImage++];
+            std::string baseName = info.filename.substr(0, info.filename.find_last_of("."));
+            Sent sent = { info.filename, fs::absolute(outputFolder + "/" + baseName + "_output.jpg").string(), {} };
+            std::string request;
+            int fd = -1;
+            if (passFd == "") {
+                request = "PROCESS\t" + fs::absolute(info.path).string() + (save ? "\t" + sent.outPath : std::string());
+            } else if (passFd == "file") {
+                request = "PROCESS_FD";
+                fd = open(info.path.c_str(), O_RDONLY | O_CLOEXEC);
+            } else {
+                int w, h, c;
+                unsigned char* pixels = stbi_load(info.path.c_str(), &w, &h, &c, 0);
+                arenaImageDone();
+                if (pixels) {
+                    fd = memfd_create("cst435-image", MFD_CLOEXEC);
+                    size_t bytes = (size_t)w * h * c;
+                    if (fd >= 0 && (ftruncate(fd, (off_t)bytes) != 0 || write(fd, pixels, bytes) != (ssize_t)bytes)) {
+                        ::close(fd);
+                        fd = -1;
+                    }
+                    stbi_image_free(pixels);
+                    request = "PROCESS_FD\tRAW\t" + std::to_string(w) + "\t" + std::to_string(h) + "\t" + std::to_string(c);
+                }
+            }
+            if (passFd != "" && fd < 0) {
+                std::cout << "Processing: " << info.filename << " ... Failed to load!" << std::endl;
+                failed++;
+                continue;
+            }
+            sent.start = DaemonClock::now();
+            bool ok = daemon.sendLine(request, fd);
+            if (fd >= 0) ::close(fd);
+            if (!ok) {
+                std::cout << "Error: Daemon closed the connection." << std::endl;
+                return 1;
+            }
+            outstanding.push_back(sent);
+        }
+        if (outstanding.empty()) continue;
+
+        // Replies come back in the order the requests were sent
+        Sent sent = outstanding.front();
+        outstanding.pop_front();
+        if (!daemon.readLine(reply)) {
+            std::cout << "Error: Daemon closed the connection." << std::endl;
+            return 1;
+        }
+        long micros = elapsedMicros(sent.start, DaemonClock::now());
+        std::cout << "Processing: " << sent.filename << " ... ";
+
+        std::istringstream in(reply);
+        std::string status;
+        int w = 0, h = 0, c = 0;
+        long decodeUs = 0, pipelineUs = 0, outputUs = 0;
+        in >> status >> w >> h >> c >> decodeUs >> pipelineUs >> outputUs;
+        if (status != "OK") {
+            std::cout << reply.substr(std::min(reply.size(), (size_t)6)) << std::endl;
+            failed++;
+            continue;
+        }
+        // Only an OK reply carries a descriptor; one queued behind an ERROR belongs to a later reply
+        int resultFd = passFd != "" ? daemon.takeFd() : -1;
+        if (resultFd >= 0) {
+            MappedInput result;
+            if (save && result.map(resultFd, error)) stbi_write_jpg(sent.outPath.c_str(), w, h, c, result.data, 100);
+            ::close(resultFd);
+        }
+        std::cout << "Done. (" << micros / 1000.0 << " ms)" << std::endl;
+        latencies.push_back(micros);
+        phases[0] += decodeUs; phases[1] += pipelineUs; phases[2] += outputUs;
+        done++;
+    }
+    std::chrono::duration<double> total = DaemonClock::now() - start;
+
+    std::string stats;
+    if (daemon.sendLine("STATS")) daemon.readLine(stats);
+    if (shutdown) {
+        daemon.sendLine("SHUTDOWN");
+        daemon.readLine(reply);
+    }
+
+    std::cout << "\n===========================================" << std::endl;
+    std::cout << "   COMPLETED!" << std::endl;
+    std::cout << "   Images Processed: " << done << (failed ? " (" + std::to_string(failed) + " failed)" : std::string()) << std::endl;
+    std::cout << "   TOTAL TIME:       " << total.count() << " seconds" << std::endl;
+    if (done > 0) {
+        long sum = 0;
+        for (long l : latencies) sum += l;
+        std::cout << "   Round trip:       " << sum / 1000.0 / done << " ms mean, " << percentile(latencies, 0.50) / 1000.0 << " p50, "
+                  << percentile(latencies, 0.99) / 1000.0 << " p99, " << *std::max_element(latencies.begin(), latencies.end()) / 1000.0 << " max" << std::endl;
+        std::cout << "   In the daemon:    " << phases[0] / 1000.0 / done << " ms decode, " << phases[1] / 1000.0 / done
+                  << " ms pipeline (whole micro-batch), " << phases[2] / 1000.0 / done << " ms output (means)" << std::endl;
+    }
+    if (!stats.empty()) std::cout << "   Daemon stats:     " << stats.substr(std::min(stats.size(), (size_t)6)) << std::endl;
+    if (shutdown) std::cout << "   Daemon shut down." << std::endl;
+    std::cout << "===========================================" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+#endif // CST435_DAEMON_H
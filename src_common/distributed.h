@@ -0,0 +1,288 @@
+/**
+ * @file distributed.h
+ * @brief Distributes the image batch over MPI ranks with dynamic work requests (src_mpi)
+ * @course CST435: Parallel Computing
+ *
+ * Only the src_mpi binary includes this file (it needs mpi.h). Rank 0 scans
+ * the input folder and broadcasts the file list, so the folder must be at
+ * the same path on every node (a shared filesystem). Files are then handed
+ * out one at a time on request rather than in fixed slices, so a rank that
+ * drew large images simply asks less often:
+ *   - rank 0's main thread is the dispatcher: it answers kTagRequest with the
+ *     next index (-1 when none is left) and sleeps kDispatchPollMicros between
+ *     polls instead of spinning on a core the pipeline needs
+ *   - rank 0 also runs a worker, on a second thread that claims straight from
+ *     the dispatcher's cursor, so only the main thread ever calls MPI
+ *   - every rank runs the normal batch loop (runBatch) with its own executor;
+ *     threads and the memory budget are split between the ranks of a node
+ * At the end the per-rank counters are gathered on rank 0, which prints one
+ * table and the parallel efficiency: busy rank-seconds / (ranks x wall time).
+ * (./manager mpi gives the speedup and efficiency over 1, 2 and 4 ranks.)
+ */
+
+#ifndef CST435_DISTRIBUTED_H
+#define CST435_DISTRIBUTED_H
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "driver.h"
+
+const int kTagRequest = 1;        // worker -> rank 0: next image please
+const int kTagAssign = 2;         // rank 0 -> worker: image index, or -1
+const int kTagLeave = 3;          // worker -> rank 0: this rank's batch loop has returned
+const int kDispatchPollMicros = 200;
+
+// ==========================================
+//               FILE LIST BROADCAST
+// ==========================================
+// One line per image: readable width height channels path
+inline std::string packImages(const std::vector<ImageInfo>& images) {
+    std::ostringstream out;
+    for (const ImageInfo& info : images) {
+        out << info.readable << ' ' << info.width << ' ' << info.height << ' ' << info.channels << ' ' << info.path << '\n';
+    }
+    return out.str();
+}
+
+inline std::vector<ImageInfo> unpackImages(const std::string& text) {
+    std::vector<ImageInfo> images;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        ImageInfo info;
+        fields >> info.readable >> info.width >> info.height >> info.channels;
+        fields.get();   // the separator; the path may contain spaces
+        std::getline(fields, info.path);
+        info.filename = std::filesystem::path(info.path).filename().string();
+        info.bytes = info.readable ? (size_t)info.width * info.height * info.channels : 0;
+        info.id = (int)images.size();
+        images.push_back(info);
+    }
+    return images;
+}
+
+// Rank 0's scan of 'folder', on every rank. False on every rank if rank 0 cannot find the folder.
+inline bool broadcastImages(int rank, const std::string& folder, std::vector<ImageInfo>& images) {
+    std::string text;
+    long long length = -1;
+    if (rank == 0 && std::filesystem::exists(folder)) {
+        text = packImages(scanImages(folder));
+        length = (long long)text.size();
+    }
+    MPI_Bcast(&length, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    if (length < 0) return false;
+    text.resize((size_t)length);
+    if (length > 0) MPI_Bcast(&text[0], (int)length, MPI_CHAR, 0, MPI_COMM_WORLD);
+    images = unpackImages(text);
+    return true;
+}
+
+// ==========================================
+//                 RANK WORKERS
+// ==========================================
+// Gathered on rank 0 as raw bytes (the ranks run the same binary).
+struct RankReport {
+    int images = 0, failed = 0, skipped = 0, threads = 0;
+    double busySeconds = 0, wallSeconds = 0;
+    long peakRssKB = 0;
+    char host[64] = {};
+};
+
+class RankSource : public WorkSource {
+public:
+    // 'next' hands out the next image index, or -1 when none is left.
+    RankSource(const std::vector<ImageInfo>& images, int rank, int localRank, std::function<int()> next)
+        : images_(images), rank_(rank), localRank_(localRank), next_(next) {}
+
+    int index() const override { return localRank_; }
+    std::string tag() const override { return "[r" + std::to_string(rank_) + "] "; }
+
+    bool claim(ImageInfo& info) override {
+        int i = next_();
+        if (i < 0) return false;
+        info = images_[i];
+        return true;
+    }
+
+    void finish(const ImageInfo&, int32_t state) override {
+        if (state == kItemDone) report.images++;
+        else if (state == kItemSkipped) report.skipped++;
+        else report.failed++;
+    }
+
+    void recordBusy(double seconds) override {
+        report.busySeconds += seconds;
+        report.peakRssKB = std::max(report.peakRssKB, peakRssKilobytes());
+    }
+
+    RankReport report;
+
+private:
+    const std::vector<ImageInfo>& images_;
+    int rank_, localRank_;
+    std::function<int()> next_;
+};
+
+// Answers work requests until every other rank has left.
+inline void dispatchImages(int ranks, const std::function<int()>& next) {
+    int remaining = ranks - 1;
+    while (remaining > 0) {
+        int pending = 0;
+        MPI_Status status;
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &pending, &status);
+        if (!pending) {
+            std::this_thread::sleep_for(std::chrono::microseconds(kDispatchPollMicros));
+            continue;
+        }
+        int unused = 0;
+        MPI_Recv(&unused, 0, MPI_INT, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        if (status.MPI_TAG == kTagLeave) {
+            remaining--;
+            continue;
+        }
+        int index = next();
+        MPI_Send(&index, 1, MPI_INT, status.MPI_SOURCE, kTagAssign, MPI_COMM_WORLD);
+    }
+}
+
+// ==========================================
+//                   MPI BATCH
+// ==========================================
+inline void printRankTable(const std::vector<RankReport>& reports) {
+    std::cout << "+------+------------------+---------+--------+--------+----------+----------+----------+" << std::endl;
+    std::cout << "| Rank | Host             | Threads | Images | Failed | Busy (s) | Wall (s) | Peak RSS |" << std::endl;
+    std::cout << "+------+------------------+---------+--------+--------+----------+----------+----------+" << std::endl;
+    for (size_t r = 0; r < reports.size(); ++r) {
+        const RankReport& p = reports[r];
+        std::cout << "| " << std::left << std::setw(4) << r << " | " << std::setw(16) << std::string(p.host).substr(0, 16)
+                  << " | " << std::setw(7) << p.threads << " | " << std::setw(6) << p.images << " | " << std::setw(6) << p.failed + p.skipped
+                  << " | " << std::setw(8) << std::fixed << std::setprecision(2) << p.busySeconds
+                  << " | " << std::setw(8) << p.wallSeconds << " | " << std::setw(8) << std::to_string(p.peakRssKB >> 10) + " MB" << " |" << std::endl;
+    }
+    std::cout << "+------+------------------+---------+--------+--------+----------+----------+----------+" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6) << std::right;
+}
+
+// Runs the batch over every rank of MPI_COMM_WORLD. Call between MPI_Init_thread and MPI_Finalize.
+inline int runMpiBatch(Options opts, const std::string& label) {
+    int rank = 0, ranks = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    // Ranks sharing a node share its CPUs and memory
+    MPI_Comm node;
+    int localRank = 0, localRanks = 1;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+    MPI_Comm_rank(node, &localRank);
+    MPI_Comm_size(node, &localRanks);
+    MPI_Comm_free(&node);
+
+    ResourceLimits limits = detectResourceLimits();
+    bool autoThreads = opts.numThreads == 0;
+    size_t budget = opts.memoryBudgetMB ? opts.memoryBudgetMB << 20 : memoryBudget(limits);
+    Options worker = opts;
+    worker.numThreads = autoThreads ? std::max(1, autoThreadCount(limits) / localRanks) : opts.numThreads;
+    worker.memoryBudgetMB = budget ? std::max<size_t>(1, (budget / localRanks) >> 20) : 0;
+    worker.processes = 1;
+    worker.useProfile = false;
+    // Loader threads would claim images, and so call MPI, off the main thread (only MPI_THREAD_FUNNELED is asked for)
+    if (rank == 0 && opts.prefetch > 0) std::cout << "Note: --prefetch is not used with MPI" << std::endl;
+    worker.prefetch = 0;
+
+    std::vector<ImageInfo> images;
+    if (!broadcastImages(rank, opts.inputFolder, images)) {
+        if (rank == 0) std::cout << "Error: Input folder '" << opts.inputFolder << "' not found." << std::endl;
+        return 1;
+    }
+    if (rank == 0 && !std::filesystem::exists(opts.outputFolder)) std::filesystem::create_directories(opts.outputFolder);
+
+    if (rank == 0) {
+        std::cout << "===========================================" << std::endl;
+        std::cout << "   STARTING BATCH PROCESSOR (" << ranks << " Ranks x " << worker.numThreads << " Threads)" << std::endl;
+        std::cout << "   [" << label << ", backend: " << opts.backend << "]" << std::endl;
+        if (autoThreads) std::cout << "   Threads: auto from " << describeLimits(limits) << ", " << localRanks << " rank(s) on this node" << std::endl;
+        std::cout << "   Work: " << images.size() << " image(s), handed out one at a time on request" << std::endl;
+        std::cout << "===========================================" << std::endl;
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::atomic<int> cursor{0};
+    auto nextLocal = [&] {
+        int i = cursor.fetch_add(1);
+        return i < (int)images.size() ? i : -1;
+    };
+    auto nextRemote = [] {
+        int index = -1;
+        MPI_Send(&index, 0, MPI_INT, 0, kTagRequest, MPI_COMM_WORLD);
+        MPI_Recv(&index, 1, MPI_INT, 0, kTagAssign, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        return index;
+    };
+    RankSource source(images, rank, localRank, rank == 0 ? std::function<int()>(nextLocal) : std::function<int()>(nextRemote));
+
+    int code = 0;
+    if (rank == 0) {
+        std::thread local([&] { code = runBatch(worker, label, &source); });
+        dispatchImages(ranks, nextLocal);
+        local.join();
+    } else {
+        code = runBatch(worker, label, &source);
+        int unused = 0;
+        MPI_Send(&unused, 0, MPI_INT, 0, kTagLeave, MPI_COMM_WORLD);
+    }
+    source.report.wallSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    source.report.threads = worker.numThreads;
+    int hostLength = 0;
+    char host[MPI_MAX_PROCESSOR_NAME];
+    MPI_Get_processor_name(host, &hostLength);
+    std::memcpy(source.report.host, host, std::min<size_t>(hostLength, sizeof(source.report.host) - 1));   // zero-filled, so it stays terminated
+
+    std::vector<RankReport> reports(rank == 0 ? ranks : 0);
+    MPI_Gather(&source.report, sizeof(RankReport), MPI_BYTE, reports.data(), sizeof(RankReport), MPI_BYTE, 0, MPI_COMM_WORLD);
+    double wall = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    if (rank != 0) return code;
+
+    // --- FINAL STATS ---
+    int processed = 0, failed = 0, threads = 0;
+    double busy = 0;
+    std::set<std::string> hosts;
+    for (const RankReport& p : reports) {
+        processed += p.images;
+        failed += p.failed + p.skipped;
+        threads += p.threads;
+        busy += p.busySeconds;
+        hosts.insert(p.host);
+    }
+    std::cout << "\n===========================================" << std::endl;
+    std::cout << "   COMPLETED!" << std::endl;
+    std::cout << "   Images Processed: " << processed << std::endl;
+    std::cout << "   Threads Used:     " << threads << std::endl;
+    std::cout << "   TOTAL TIME:       " << wall << " seconds" << std::endl;
+    std::cout << "   Ranks:            " << ranks << " on " << hosts.size() << " node(s), " << failed << " image(s) failed or skipped" << std::endl;
+    std::cout << "   Efficiency:       " << std::fixed << std::setprecision(1) << 100.0 * busy / (ranks * wall)
+              << "% (busy rank-seconds / ranks x wall time)" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+    std::cout << "===========================================" << std::endl;
+    printRankTable(reports);
+
+    return code;
+}
+
+#endif // CST435_DISTRIBUTED_H
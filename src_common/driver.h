@@ -0,0 +1,867 @@
+/**
+ * @file driver.h
+ * @brief Command line options and the batch loop shared by both implementations
+ * @course CST435: Parallel Computing
+ *
+ * Each main.cpp only picks its default backend, output folder and banner;
+ * loading, the filter pipeline, timing and the final report live here so the
+ * benchmark compares backends on exactly the same work.
+ *
+ * Usage: ./main [numThreads] [--backend=NAME] [--input=DIR] [--output=DIR] [--save]
+ *               [--pipeline=SPEC | --pipeline-file=PATH] [--print-plan]
+ *               [--border=clamp|mirror|wrap|constant[:VALUE]]
+ *               [--schedule=PRESET|SPEC] [--dag[=TILE_ROWS]] [--layout=interleaved|planar]
+ *               [--partition=aligned|rows] [--counters]
+ *               [--affinity=none|compact|scatter|nosmt] [--memory-budget=MB] [--prefetch=N]
+ *               [--pages=small|thp|hugetlb] [--no-prefault] [--stream-stores=auto|on|off]
+ *               [--in-place] [--batch=K] [--processes=N] [--watch [--settle-ms=MS]]
+ *               [--stream[=frames|tar]]
+ *               [--coordinate[=PORT] [--local-workers=N] | --worker=HOST:PORT]
+ *               [--lease-size=K] [--lease-seconds=S]
+ *               [--daemon=SOCKET [--batch-window=MS] | --client=SOCKET [--client-fd[=raw|file]]
+ *                [--lane=interactive|bulk] [--in-flight=N] [--shutdown]]
+ *               [--autotune[=SAMPLES]] [--profile-dir=DIR] [--no-profile]
+ *               [--jit] [--jit-cache=DIR]
+ *
+ * If none of numThreads/--backend/--schedule/--dag/--layout/--partition/
+ * --affinity/--in-place is given, the settings saved by --autotune for this host (see
+ * autotune.h) are used when present. Without a thread count (from the
+ * command line or a profile) the CPUs the container may use decide it, and
+ * the frame buffers are sized to its memory limit (see resources.h).
+ * With --processes=N the threads and the memory budget are split between N
+ * forked worker processes that share a work queue (see processes.h).
+ * --coordinate serves leases on the input files over TCP to --worker
+ * processes on this or other hosts (see leasing.h).
+ * --watch processes the input folder, then every file that arrives in it,
+ * until interrupted (see watch.h).
+ * --stream reads encoded images from stdin and writes the results to stdout,
+ * for shell pipelines (see stream.h).
+ * --daemon keeps the workers and frame buffers warm and serves single images
+ * over a Unix socket, in micro-batches of up to --batch requests; --client
+ * sends it the input folder (see daemon.h).
+ */
+
+#ifndef CST435_DRIVER_H
+#define CST435_DRIVER_H
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "../include/stb_image.h"
+#include "../include/stb_image_write.h"
+#include "admission.h"
+#include "executor.h"
+#include "autotune.h"
+#include "daemon.h"
+#include "perf_counters.h"
+#include "leasing.h"
+#include "processes.h"
+#include "resources.h"
+#include "runner.h"
+#include "stream.h"
+#include "topology.h"
+#include "watch.h"
+
+// ==========================================
+//            COMMAND LINE OPTIONS
+// ==========================================
+struct Options {
+    int numThreads = 0;                           // 0 = size from the container's CPU limits
+    std::string backend;                          // empty = the binary's default backend
+    std::string inputFolder = "../data/images";   // input folder
+    std::string outputFolder;                     // output folder
+    bool saveOutput = false;                      // write results (off while benchmarking)
+    std::string pipeline = kDefaultPipeline;      // stage list, see pipeline.h
+    bool printPlan = false;                       // print the compiled plan for the first image
+    std::string border = "clamp";                 // how stencils read outside the image, see filters.h
+    std::string schedule;                         // empty = plain row kernels, see schedule.h
+    int dagTileRows = 0;                          // > 0 = barrier-free tile DAG, see tile_dag.h
+    std::string layout = "interleaved";           // pixel layout inside the pipeline, see planar.h
+    bool alignRows = true;                        // --partition=aligned: cut rows on cache lines
+    bool counters = false;                        // per-worker write-miss counters, see perf_counters.h
+    std::string affinity = "none";                // worker placement, see topology.h
+    size_t memoryBudgetMB = 0;                    // 0 = derive from the memory limit
+    int prefetch = 0;                             // images decoded ahead by loader threads, see admission.h
+    std::string pages = "small";                  // frame page size, see pages.h
+    bool prefault = true;                         // fault frames in before the timer starts
+    int batch = 1;                                // images sharing each step's parallel region
+    int processes = 1;                            // > 1 = forked workers on a shared work queue, see processes.h
+    bool watch = false;                           // keep processing files as they arrive, see watch.h
+    int settleMillis = kDefaultSettleMillis;      // watch: quiet time before a written file is taken
+    std::string stream;                           // "frames" or "tar": images on stdin, results on stdout
+    int coordinatePort = -1;                      // >= 0 = serve file leases over TCP (0 = any free port), see leasing.h
+    int localWorkers = 0;                         // lease workers forked by the coordinator on this host
+    std::string leaseWorker;                      // HOST:PORT of the coordinator this worker leases from
+    int leaseSize = 8;                            // files per lease
+    int leaseSeconds = 10;                        // coordinator: a lease not renewed for this long goes back to the queue
+    std::string daemonSocket;                     // serve single images on this Unix socket, see daemon.h
+    double batchWindowMs = 2.0;                   // daemon: how long a micro-batch collects requests
+    std::string clientSocket;                     // send the input folder to the daemon on this socket
+    std::string clientFd;                         // client: "" = by path, "raw" = decoded memfds, "file" = open files
+    std::string lane = "interactive";             // client: the daemon lane its requests queue on
+    int inFlight = 1;                             // client: requests outstanding at a time
+    bool shutdownDaemon = false;                  // client: stop the daemon once the images are sent
+    bool inPlace = false;                         // stencils overwrite their input, see runStencilInPlace()
+    std::string streamStores = "auto";            // non-temporal point-stage output: auto = frames above the LLC
+    bool executionGiven = false;                  // any execution setting given on the command line
+    int autotuneSamples = 0;                      // > 0 = run the autotuner instead of the batch
+    std::string profileDir = "../profiles";       // where tuned per-host profiles live
+    bool useProfile = true;
+    bool jit = false;                             // runtime-specialised convolution kernels, see jit.h
+    std::string jitCacheDir = "../jit_cache";     // compiled kernel cache
+};
+
+inline bool startsWith(const std::string& s, const std::string& prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Parses argv on top of 'opts' (which already holds the binary's defaults).
+// Returns false and prints the reason if an argument is not understood.
+inline bool parseOptions(int argc, char* argv[], Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (startsWith(arg, "--backend=")) { opts.backend = arg.substr(10); opts.executionGiven = true; }
+        else if (startsWith(arg, "--input=")) opts.inputFolder = arg.substr(8);
+        else if (startsWith(arg, "--output=")) opts.outputFolder = arg.substr(9);
+        else if (arg == "--save") opts.saveOutput = true;
+        else if (startsWith(arg, "--pipeline=")) opts.pipeline = arg.substr(11);
+        else if (startsWith(arg, "--pipeline-file=")) {
+            std::string error;
+            if (!loadPipelineFile(arg.substr(16), opts.pipeline, error)) {
+                std::cout << "Error: " << error << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--print-plan") opts.printPlan = true;
+        else if (startsWith(arg, "--border=")) opts.border = arg.substr(9);
+        else if (startsWith(arg, "--schedule=")) { opts.schedule = arg.substr(11); opts.executionGiven = true; }
+        else if (arg == "--dag") { opts.dagTileRows = kDefaultDagTileRows; opts.executionGiven = true; }
+        else if (startsWith(arg, "--dag=")) { opts.dagTileRows = std::max(1, std::atoi(arg.c_str() + 6)); opts.executionGiven = true; }
+        else if (startsWith(arg, "--layout=")) { opts.layout = arg.substr(9); opts.executionGiven = true; }
+        else if (arg == "--partition=aligned" || arg == "--partition=rows") { opts.alignRows = (arg == "--partition=aligned"); opts.executionGiven = true; }
+        else if (arg == "--counters") opts.counters = true;
+        else if (startsWith(arg, "--memory-budget=")) opts.memoryBudgetMB = std::strtoull(arg.c_str() + 16, nullptr, 10);
+        else if (startsWith(arg, "--prefetch=")) opts.prefetch = std::max(0, std::atoi(arg.c_str() + 11));
+        else if (startsWith(arg, "--pages=")) opts.pages = arg.substr(8);
+        else if (arg == "--no-prefault") opts.prefault = false;
+        else if (startsWith(arg, "--stream-stores=")) opts.streamStores = arg.substr(16);
+        else if (startsWith(arg, "--batch=")) opts.batch = std::max(1, std::atoi(arg.c_str() + 8));
+        else if (startsWith(arg, "--processes=")) opts.processes = std::max(1, std::atoi(arg.c_str() + 12));
+        else if (arg == "--watch") opts.watch = true;
+        else if (startsWith(arg, "--settle-ms=")) opts.settleMillis = std::max(0, std::atoi(arg.c_str() + 12));
+        else if (arg == "--stream") opts.stream = "frames";
+        else if (startsWith(arg, "--stream=")) opts.stream = arg.substr(9);
+        else if (arg == "--coordinate") opts.coordinatePort = 0;
+        else if (startsWith(arg, "--coordinate=")) opts.coordinatePort = std::max(0, std::atoi(arg.c_str() + 13));
+        else if (startsWith(arg, "--local-workers=")) opts.localWorkers = std::max(0, std::atoi(arg.c_str() + 16));
+        else if (startsWith(arg, "--worker=")) opts.leaseWorker = arg.substr(9);
+        else if (startsWith(arg, "--lease-size=")) opts.leaseSize = std::max(1, std::atoi(arg.c_str() + 13));
+        else if (startsWith(arg, "--lease-seconds=")) opts.leaseSeconds = std::max(1, std::atoi(arg.c_str() + 16));
+        else if (startsWith(arg, "--daemon=")) opts.daemonSocket = arg.substr(9);
+        else if (startsWith(arg, "--client=")) opts.clientSocket = arg.substr(9);
+        else if (arg == "--client-fd") opts.clientFd = "raw";
+        else if (startsWith(arg, "--client-fd=")) opts.clientFd = arg.substr(12);
+        else if (startsWith(arg, "--batch-window=")) opts.batchWindowMs = std::max(0.0, std::atof(arg.c_str() + 15));
+        else if (startsWith(arg, "--lane=")) opts.lane = arg.substr(7);
+        else if (startsWith(arg, "--in-flight=")) opts.inFlight = std::max(1, std::atoi(arg.c_str() + 12));
+        else if (arg == "--shutdown") opts.shutdownDaemon = true;
+        else if (arg == "--in-place") { opts.inPlace = true; opts.executionGiven = true; }
+        else if (startsWith(arg, "--affinity=") && isPlacementName(arg.substr(11))) { opts.affinity = arg.substr(11); opts.executionGiven = true; }
+        else if (arg == "--autotune") opts.autotuneSamples = 8;
+        else if (startsWith(arg, "--autotune=")) opts.autotuneSamples = std::max(1, std::atoi(arg.c_str() + 11));
+        else if (startsWith(arg, "--profile-dir=")) opts.profileDir = arg.substr(14);
+        else if (arg == "--no-profile") opts.useProfile = false;
+        else if (arg == "--jit") opts.jit = true;
+        else if (startsWith(arg, "--jit-cache=")) { opts.jitCacheDir = arg.substr(12); opts.jit = true; }
+        else if (!arg.empty() && std::isdigit((unsigned char)arg[0])) { opts.numThreads = std::atoi(arg.c_str()); opts.executionGiven = true; }
+        else {
+            std::cout << "Error: Unknown argument '" << arg << "'" << std::endl;
+            return false;
+        }
+    }
+    if (opts.numThreads < 0) opts.numThreads = 0;
+    return true;
+}
+
+// ==========================================
+// MAIN BATCH PROCESSOR
+// ==========================================
+// Replaces the execution settings with the tuned profile for this host, if any.
+// A profiled backend that is not compiled into this binary keeps the default backend.
+inline void applyTunedProfile(Options& opts) {
+    if (opts.executionGiven || !opts.useProfile) return;
+    TunedProfile profile;
+    std::string path = profilePath(opts.profileDir);
+    if (!loadProfile(path, profile)) return;
+
+    opts.numThreads = profile.numThreads;
+    if (makeExecutor(profile.backend, 1)) opts.backend = profile.backend;
+    opts.schedule = profile.schedule;
+    opts.dagTileRows = profile.dagTileRows;
+    opts.layout = profile.layout;
+    std::cout << "Loaded tuned profile: " << path << std::endl;
+}
+
+// The pipeline's execution mode and the frame page size from the command line.
+// Prints the reason and returns false if a setting is not understood.
+inline bool setUpExecution(const Options& opts, ExecutionMode& mode, PageMode& pageMode) {
+    std::string error;
+    if (!configureExecution(opts.pipeline, opts.schedule, opts.dagTileRows, opts.jit ? opts.jitCacheDir : "", opts.layout, opts.border, mode, error)) {
+        std::cout << "Error: " << error << std::endl;
+        return false;
+    }
+    mode.alignRows = opts.alignRows;
+    if (opts.inPlace && !enableInPlaceStencils(mode, error)) {
+        std::cout << "Error: " << error << std::endl;
+        return false;
+    }
+    if (opts.streamStores == "on") mode.streamAbove = 0;
+    else if (opts.streamStores == "off") mode.streamAbove = kNeverStream;
+    else if (opts.streamStores != "auto") {
+        std::cout << "Error: Unknown --stream-stores mode '" << opts.streamStores << "' (use auto, on or off)" << std::endl;
+        return false;
+    }
+    if (!parsePageMode(opts.pages, pageMode)) {
+        std::cout << "Error: Unknown page mode '" << opts.pages << "' (use small, thp or hugetlb)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Frames that stay allocated for the whole run: the pipeline buffers, the decoding
+// image, the encoder's copy and any planar planes.
+inline int fixedFrames(const ExecutionMode& mode) {
+    return executionBuffers(mode) + 1 + (mode.planar ? mode.plan.numBuffers + 1 : 0);
+}
+
+// 4000x4000x4 is a safe size for most standard images; under a memory 'budget' (0 = none)
+// every fixed frame must fit, and images that do not fit are skipped.
+inline size_t frameBufferSize(const ExecutionMode& mode, size_t budget) {
+    size_t bufferSize = 4000 * 4000 * 4; // width * height * max channels
+    if (budget) bufferSize = std::max(kPageBytes, std::min(bufferSize, budget / (fixedFrames(mode) + 2) / kPageBytes * kPageBytes));
+    return bufferSize;
+}
+
+inline int runProcesses(Options opts, const std::string& label);
+inline int runCoordinator(Options opts, const std::string& label);
+inline int runLeaseWorker(Options opts, const std::string& label, int slot);
+inline int runDaemon(Options opts, const std::string& label);
+inline int runWatch(Options opts, const std::string& label);
+inline int runStream(Options opts, const std::string& label);
+
+// 'source' is set in a worker of --processes, --worker or an MPI run: images are claimed
+// from it, and only the per-image lines are printed (the launcher, coordinator or rank 0 reports).
+// A standalone source (--watch, --stream) reports like a plain run.
+inline int runBatch(Options opts, const std::string& label, WorkSource* source = nullptr) {
+    namespace fs = std::filesystem;
+
+    if (opts.autotuneSamples > 0) {
+        return runAutotune(opts.inputFolder, opts.pipeline, opts.profileDir, opts.autotuneSamples);
+    }
+    applyTunedProfile(opts);
+    if (!source) {
+        if (opts.processes > 1) return runProcesses(opts, label);
+        if (opts.coordinatePort >= 0) return runCoordinator(opts, label);
+        if (!opts.leaseWorker.empty()) return runLeaseWorker(opts, label, 0);
+        if (opts.watch) return runWatch(opts, label);
+        if (!opts.stream.empty()) return runStream(opts, label);
+        if (!opts.daemonSocket.empty()) return runDaemon(opts, label);
+        if (!opts.clientSocket.empty()) return runDaemonClient(opts.clientSocket, opts.inputFolder, opts.outputFolder, opts.saveOutput, opts.clientFd,
+                                                                      opts.lane, opts.inFlight, opts.shutdownDaemon);
+    }
+
+    bool report = !source || source->standalone();
+    ExecutionMode mode;
+    PageMode pageMode;
+    if (!setUpExecution(opts, mode, pageMode)) return 1;
+
+    ResourceLimits limits = detectResourceLimits();
+    bool autoThreads = opts.numThreads == 0;
+    if (autoThreads) opts.numThreads = autoThreadCount(limits);
+
+    // --- PIPELINE BUFFER SIZE ---
+    // Whatever the fixed frames leave of the budget is what decoded images may commit.
+    size_t budget = opts.memoryBudgetMB ? opts.memoryBudgetMB << 20 : memoryBudget(limits);
+    size_t bufferSize = frameBufferSize(mode, budget);
+    size_t fixedBytes = fixedFrames(mode) * bufferSize;
+    size_t imageBudget = !budget ? 0 : budget > fixedBytes ? budget - fixedBytes : 1;
+
+    std::unique_ptr<Executor> exec = makeExecutor(opts.backend, opts.numThreads);
+    if (!exec) {
+        std::cout << "Error: Backend '" << opts.backend << "' is not available. Choose from:";
+        for (const auto& b : availableBackends()) std::cout << " " << b;
+        std::cout << std::endl;
+        return 1;
+    }
+    Topology topology = discoverTopology();
+    std::vector<LogicalCpu> placement;
+    int pinned = 0;
+    if (opts.affinity != "none") {
+        // Worker processes take consecutive ranges of the placement order
+        int skip = source ? source->index() * exec->threads() : 0;
+        placement = placeWorkers(topology, opts.affinity, skip + exec->threads());
+        placement.erase(placement.begin(), placement.begin() + std::min(skip, (int)placement.size()));
+        pinned = pinWorkers(*exec, placement);
+    }
+    // Frame pages follow their rows' workers only when there is more than one node to choose from
+    bool numaFirstTouch = pinned > 0 && topology.nodes > 1;
+
+    CountingExecutor* counting = nullptr;
+    if (opts.counters) {
+        counting = new CountingExecutor(std::move(exec));
+        exec.reset(counting);
+    }
+
+    // --- PIPELINE BUFFERS ---
+    // The plan decides how many intermediate buffers are needed (at most two: stencil
+    // stages ping-pong between them, point stages run in place).
+    // Buffers are page aligned so row ranges can be cut on cache-line boundaries, and
+    // pre-faulted by the workers so the timed batch does not take their first-touch faults.
+    std::vector<unsigned char*> buffers(executionBuffers(mode), nullptr);
+    for (auto& buf : buffers) {
+        buf = allocateFrame(bufferSize, pageMode);
+        if (!buf) {
+            std::cout << "Memory allocation failed!" << std::endl;
+            for (auto* b : buffers) releaseFrame(b);
+            return 1;
+        }
+        if (opts.prefault) prefaultFrame(*exec, buf, bufferSize);
+    }
+
+    if (!(source && source->takesResults()) && !fs::exists(opts.outputFolder)) fs::create_directories(opts.outputFolder);
+
+    // --- UI HEADER ---
+    if (report) {
+        std::cout << "===========================================" << std::endl;
+        std::cout << "   STARTING BATCH PROCESSOR (" << exec->threads() << " Threads)" << std::endl;
+        std::cout << "   [" << label << ", backend: " << exec->name() << "]" << std::endl;
+        if (autoThreads) std::cout << "   Threads: auto from " << describeLimits(limits) << std::endl;
+        if (budget) std::cout << "   Memory budget: " << (budget >> 20) << " MB -> " << executionBuffers(mode) << " frame buffer(s) of " << (bufferSize >> 20) << " MB" << std::endl;
+        if (opts.border != "clamp") std::cout << "   Border: " << opts.border << std::endl;
+        if (mode.useSchedule) std::cout << "   Schedule: " << describeSchedule(mode.schedule) << std::endl;
+        if (opts.jit) std::cout << "   Kernels: JIT-specialised (cache: " << opts.jitCacheDir << ")" << std::endl;
+        if (mode.dagTileRows > 0) std::cout << "   Execution: tile DAG (" << mode.dagTileRows << "-row tiles, no stage barriers)" << std::endl;
+        if (opts.affinity != "none") {
+            std::cout << "   Topology: " << describeTopology(topology) << std::endl;
+            std::cout << "   Placement: " << opts.affinity << " (" << pinned << "/" << exec->threads() << " workers pinned"
+                      << (numaFirstTouch ? ", frames first-touched per node" : "") << ")" << std::endl;
+            std::cout << "     " << describePlacement(placement) << std::endl;
+        }
+        if (opts.prefetch > 0) std::cout << "   Prefetch: " << opts.prefetch << " loader thread(s)"
+                                          << (imageBudget ? ", decoded images within " + std::to_string(imageBudget >> 20) + " MB" : std::string()) << std::endl;
+        if (pageMode != PageMode::Small || !opts.prefault) {
+            bool pooled = pageMode != PageMode::HugeTlb || !hugeTlbFrames().lengths.empty();
+            std::cout << "   Pages: " << pageModeName(pageMode) << (pooled ? "" : " (pool empty, thp used)") << (opts.prefault ? ", prefaulted" : ", faulted on first touch");
+            if (pageMode != PageMode::Small) std::cout << " (" << (hugePageKilobytes() >> 10) << " MB on huge pages)";
+            std::cout << std::endl;
+        }
+        if (opts.streamStores != "off" && !mode.planar && !mode.useSchedule && mode.dagTileRows == 0) {
+            std::cout << "   Point-stage stores: non-temporal for frames >= " << (mode.streamAbove >> 20) << " MB"
+                      << (opts.streamStores == "auto" ? " (last-level cache)" : "") << std::endl;
+        }
+        if (opts.batch > 1) std::cout << "   Batching: up to " << opts.batch << " images per parallel region"
+                                       << (mode.useSchedule || mode.dagTileRows > 0 || mode.planar ? " (this mode runs them one by one)" : "") << std::endl;
+        if (opts.inPlace) std::cout << "   Buffers: " << mode.plan.numBuffers << " frame(s), stencils in place over a " << kStencilLines << "-line ring" << std::endl;
+        if (mode.planar) std::cout << "   Layout: planar (one " << kPlaneAlign << "-byte aligned plane per channel)" << std::endl;
+        std::cout << "===========================================" << std::endl;
+    }
+
+    // A work source was set up from the folder (or a stream) by its launcher
+    if (!source && !fs::exists(opts.inputFolder)) {
+        std::cout << "Error: Input folder '" << opts.inputFolder << "' not found." << std::endl;
+        for (auto* buf : buffers) releaseFrame(buf);
+        return 1;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    PageFaults faultsBefore = pageFaults();
+    int fileCount = 0;
+
+    int touchedWidth = 0, touchedHeight = 0, touchedChannels = 0;
+
+    // BATCH LOOP
+    // Sizes come from the image headers, so oversized images are skipped before decoding.
+    // A worker claims its images one at a time from its work source instead.
+    std::string tag = source ? source->tag() : "";
+    std::vector<ImageInfo> images;
+    ImageFeed::Claim claim;
+    if (source) {
+        claim = [&](ImageInfo& info) {
+            while (source->claim(info)) {
+                if (!info.readable || info.bytes <= bufferSize) return true;
+                std::cout << tag << "Processing: " << info.filename << " ... Too large for pipeline buffers, skipped." << std::endl;
+                source->finish(info, kItemSkipped);
+            }
+            return false;
+        };
+    } else {
+        for (const ImageInfo& info : scanImages(opts.inputFolder)) {
+            if (info.readable && info.bytes > bufferSize) {
+                std::cout << "Processing: " << info.filename << " ... Too large for pipeline buffers, skipped." << std::endl;
+                continue;
+            }
+            images.push_back(info);
+        }
+    }
+    ImageFeed feed(images, imageBudget, opts.prefetch, claim);
+
+    // Up to opts.batch images are gathered at a time, packed side by side (page aligned)
+    // into the frame buffers, and run with one parallel region per step (see executePlanBatch)
+    LoadedImage carried;
+    bool haveCarried = false;
+    while (true) {
+        auto groupStart = std::chrono::high_resolution_clock::now();
+        std::vector<LoadedImage> group;
+        size_t packed = 0;
+        while ((int)group.size() < opts.batch) {
+            LoadedImage loaded;
+            if (haveCarried) { loaded = carried; haveCarried = false; }
+            else if (!feed.next(loaded, group.empty())) break;   // a partial group runs rather than wait on its own budget
+            if (!loaded.pixels) {
+                std::cout << tag << "Processing: " << loaded.info.filename << " ... Failed to load!" << std::endl;
+                if (source) source->finish(loaded.info, kItemFailed);
+                continue;
+            }
+            size_t bytes = (loaded.info.bytes + kPageBytes - 1) / kPageBytes * kPageBytes;
+            if (!group.empty() && packed + bytes > bufferSize) { carried = loaded; haveCarried = true; break; }
+            group.push_back(loaded);
+            packed += bytes;
+        }
+        if (group.empty()) break;
+
+        std::vector<BatchImage> batch(group.size());
+        size_t offset = 0;
+        for (size_t i = 0; i < group.size(); ++i) {
+            const ImageInfo& info = group[i].info;
+            batch[i].img = group[i].pixels;
+            batch[i].width = info.width; batch[i].height = info.height; batch[i].channels = info.channels;
+            for (auto* buf : buffers) batch[i].buffers.push_back(buf + offset);
+            offset += (info.bytes + kPageBytes - 1) / kPageBytes * kPageBytes;
+        }
+
+        // Re-place the frame pages whenever the row geometry (and so the row split) changes
+        const BatchImage& first = batch[0];
+        if (numaFirstTouch && batch.size() == 1 && (first.width != touchedWidth || first.height != touchedHeight || first.channels != touchedChannels)) {
+            size_t rowBytes = (size_t)first.width * first.channels;
+            for (auto* buf : buffers) firstTouchRows(*exec, buf, rowBytes, first.height, rowGrain(mode.alignRows, rowBytes, first.height, exec->threads()));
+            touchedWidth = first.width; touchedHeight = first.height; touchedChannels = first.channels;
+        }
+
+        if (opts.printPlan && fileCount == 0) printPlan(mode.plan, first.width, first.height, first.channels);
+
+        runImageBatch(*exec, mode, batch);
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const ImageInfo& info = group[i].info;
+            std::cout << tag << "Processing: " << info.filename << " ... ";
+            if (!batch[i].result) {
+                std::cout << "Memory allocation failed!" << std::endl;
+                if (source) source->finish(info, kItemFailed);
+                feed.release(group[i]);
+                continue;
+            }
+
+            // Save final result from the plan's result buffer
+            // (disabled by default so disk I/O does not distort the timings)
+            if (source && source->takesResults()) {
+                source->putResult(info, batch[i].result);
+            } else if (opts.saveOutput) {
+                // Separate base name for output naming
+                std::string baseName = info.filename.substr(0, info.filename.find_last_of("."));
+                std::string outPath = opts.outputFolder + "/" + baseName + "_output.jpg";
+                stbi_write_jpg(outPath.c_str(), info.width, info.height, info.channels, batch[i].result, 100);
+            }
+
+            // Cleanup
+            feed.release(group[i]);
+            fileCount++;
+            std::cout << "Done." << (batch.size() > 1 ? " (batch of " + std::to_string(batch.size()) + ")" : std::string()) << std::endl;
+            if (source) source->finish(info, kItemDone);
+        }
+        if (source) source->recordBusy(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - groupStart).count());
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> diff = end - start;
+    PageFaults faultsAfter = pageFaults();
+    for (auto* buf : buffers) releaseFrame(buf);
+    if (!report) return 0;
+
+    // --- FINAL STATS ---
+    std::cout << "\n===========================================" << std::endl;
+    std::cout << "   COMPLETED!" << std::endl;
+    std::cout << "   Images Processed: " << fileCount << std::endl;
+    std::cout << "   Threads Used:     " << exec->threads() << std::endl;
+    std::cout << "   TOTAL TIME:       " << diff.count() << " seconds" << std::endl;
+    std::cout << "   Page faults:      " << faultsAfter.minor - faultsBefore.minor << " minor, "
+              << faultsAfter.major - faultsBefore.major << " major" << std::endl;
+    std::cout << "   Decoder arena:    " << describeArenaStats() << std::endl;
+    if (opts.prefetch > 0) std::cout << "   Peak decoded:     " << (feed.peakCommitted() >> 20) << " MB (" << feed.overtakes() << " small image(s) admitted ahead)" << std::endl;
+    if (counting) counting->report();
+    std::cout << "===========================================" << std::endl;
+
+    return 0;
+}
+
+// ==========================================
+// MULTI-PROCESS LAUNCHER
+// ==========================================
+// The launcher only scans the folder and supervises; every forked worker runs
+// runBatch() on images claimed from the shared queue, with its share of the
+// threads and of the memory budget.
+inline int runProcesses(Options opts, const std::string& label) {
+    namespace fs = std::filesystem;
+
+    if (!fs::exists(opts.inputFolder)) {
+        std::cout << "Error: Input folder '" << opts.inputFolder << "' not found." << std::endl;
+        return 1;
+    }
+    std::vector<std::string> backends = availableBackends();
+    if (std::find(backends.begin(), backends.end(), opts.backend) == backends.end()) {
+        std::cout << "Error: Backend '" << opts.backend << "' is not available. Choose from:";
+        for (const auto& b : backends) std::cout << " " << b;
+        std::cout << std::endl;
+        return 1;
+    }
+
+    ResourceLimits limits = detectResourceLimits();
+    bool autoThreads = opts.numThreads == 0;
+    int totalThreads = autoThreads ? autoThreadCount(limits) : opts.numThreads;
+    size_t budget = opts.memoryBudgetMB ? opts.memoryBudgetMB << 20 : memoryBudget(limits);
+
+    Options worker = opts;
+    worker.numThreads = std::max(1, totalThreads / opts.processes);
+    worker.memoryBudgetMB = budget ? std::max<size_t>(1, (budget / opts.processes) >> 20) : 0;
+    worker.useProfile = false;
+
+    WorkQueue queue;
+    if (!queue.create(scanImages(opts.inputFolder), opts.processes)) {
+        std::cout << "Error: Could not map the shared work queue (" << std::strerror(errno) << ")" << std::endl;
+        return 1;
+    }
+    // Created here so the workers do not race to create it
+    if (!fs::exists(opts.outputFolder)) fs::create_directories(opts.outputFolder);
+
+    // --- UI HEADER ---
+    std::cout << "===========================================" << std::endl;
+    std::cout << "   STARTING BATCH PROCESSOR (" << opts.processes << " Processes x " << worker.numThreads << " Threads)" << std::endl;
+    std::cout << "   [" << label << ", backend: " << opts.backend << "]" << std::endl;
+    if (autoThreads) std::cout << "   Threads: auto from " << describeLimits(limits) << std::endl;
+    if (budget) std::cout << "   Memory budget: " << (budget >> 20) << " MB, " << worker.memoryBudgetMB << " MB per process" << std::endl;
+    std::cout << "   Work queue: " << queue.unsettled() << " image(s) in a " << (queue.segmentBytes() + 1023) / 1024
+              << " KB memfd segment (up to " << kMaxAttempts << " attempts per image)" << std::endl;
+    std::cout << "===========================================" << std::endl;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    superviseWorkers(queue, [&](int) { return runBatch(worker, label, &queue); });
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> diff = end - start;
+
+    int images = 0, failed = 0, skipped = 0, crashes = 0, restarts = 0, givenUp = 0;
+    for (int s = 0; s < queue.slots(); ++s) {
+        ProcessSlot& slot = queue.slot(s);
+        images += slot.images;
+        failed += slot.failed;
+        skipped += slot.skipped;
+        crashes += slot.crashes;
+        restarts += slot.restarts;
+        givenUp += slot.givenUp;
+    }
+
+    // --- FINAL STATS ---
+    std::cout << "\n===========================================" << std::endl;
+    std::cout << "   COMPLETED!" << std::endl;
+    std::cout << "   Images Processed: " << images << std::endl;
+    std::cout << "   Threads Used:     " << opts.processes * worker.numThreads << std::endl;
+    std::cout << "   TOTAL TIME:       " << diff.count() << " seconds" << std::endl;
+    std::cout << "   Processes:        " << opts.processes << " (" << crashes << " crash(es), " << restarts << " replacement(s), "
+              << givenUp << " given up, " << failed << " failed, " << skipped << " skipped, " << queue.unsettled() << " never settled)" << std::endl;
+    for (int s = 0; s < queue.slots(); ++s) {
+        ProcessSlot& slot = queue.slot(s);
+        std::cout << "     p" << s << " (pid " << slot.pid << "): " << slot.images << " image(s), "
+                  << slot.busyMicros / 1000000.0 << " s busy, " << (slot.peakRssKB >> 10) << " MB peak RSS" << std::endl;
+    }
+    std::cout << "===========================================" << std::endl;
+
+    return 0;
+}
+
+// ==========================================
+// TCP LEASE COORDINATOR AND WORKERS
+// ==========================================
+// A --worker: leases files from the coordinator and runs runBatch() on them.
+// 'slot' numbers the workers forked on one host (their CPU placement offset).
+inline int runLeaseWorker(Options opts, const std::string& label, int slot) {
+    size_t colon = opts.leaseWorker.rfind(':');
+    if (colon == std::string::npos) {
+        std::cout << "Error: --worker needs HOST:PORT, got '" << opts.leaseWorker << "'" << std::endl;
+        return 1;
+    }
+    std::string host = opts.leaseWorker.substr(0, colon);
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+    int port = std::atoi(opts.leaseWorker.c_str() + colon + 1);
+    if (opts.numThreads == 0) opts.numThreads = autoThreadCount(detectResourceLimits());
+
+    // A lease may have to wait for images the batch loop holds, which loader threads would not give back
+    if (opts.prefetch > 0) std::cout << "Note: --prefetch is not used with --worker" << std::endl;
+    opts.prefetch = 0;
+
+    LeaseSource source(slot);
+    std::string error;
+    if (!source.connect(host, port, opts.numThreads, error)) {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+    int code = runBatch(opts, label, &source);
+    std::cout << source.tag() << "Finished: " << source.images() << " image(s), " << source.lostLeases() << " lease(s) lost" << std::endl;
+    return code;
+}
+
+// The coordinator only scans and hands out leases; --local-workers=N forks N
+// workers that connect over localhost, with the threads and the memory budget
+// split between them.
+inline int runCoordinator(Options opts, const std::string& label) {
+    namespace fs = std::filesystem;
+
+    if (!fs::exists(opts.inputFolder)) {
+        std::cout << "Error: Input folder '" << opts.inputFolder << "' not found." << std::endl;
+        return 1;
+    }
+    LeaseCoordinator coordinator(scanImages(opts.inputFolder), opts.leaseSize, opts.leaseSeconds);
+    std::string error;
+    if (!coordinator.listen(opts.coordinatePort, error)) {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+    if (!fs::exists(opts.outputFolder)) fs::create_directories(opts.outputFolder);
+
+    ResourceLimits limits = detectResourceLimits();
+    size_t budget = opts.memoryBudgetMB ? opts.memoryBudgetMB << 20 : memoryBudget(limits);
+    int localWorkers = opts.localWorkers;
+    Options worker = opts;
+    worker.coordinatePort = -1;
+    worker.leaseWorker = "localhost:" + std::to_string(coordinator.port());
+    worker.useProfile = false;
+    if (localWorkers > 0) {
+        worker.numThreads = std::max(1, (opts.numThreads ? opts.numThreads : autoThreadCount(limits)) / localWorkers);
+        worker.memoryBudgetMB = budget ? std::max<size_t>(1, (budget / localWorkers) >> 20) : 0;
+    }
+
+    // --- UI HEADER ---
+    std::cout << "===========================================" << std::endl;
+    std::cout << "   STARTING LEASE COORDINATOR (port " << coordinator.port() << ")" << std::endl;
+    std::cout << "   [" << label << "]" << std::endl;
+    std::cout << "   Work: " << coordinator.unsettled() << " file(s) in leases of " << opts.leaseSize << ", expiring after "
+              << opts.leaseSeconds << " s without renewal" << std::endl;
+    if (localWorkers > 0) std::cout << "   Local workers: " << localWorkers << " x " << worker.numThreads << " threads (backend: " << opts.backend << ")" << std::endl;
+    else std::cout << "   Waiting for workers: ./main --worker=HOST:" << coordinator.port() << std::endl;
+    std::cout << "===========================================" << std::endl;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<pid_t> children;
+    for (int w = 0; w < localWorkers; ++w) {
+        std::cout.flush();   // the child would write the coordinator's buffered output again
+        pid_t pid = fork();
+        if (pid == 0) {
+            ::close(coordinator.listenFd());
+            int code = runLeaseWorker(worker, label, w);
+            std::cout.flush();
+            _exit(code);
+        }
+        if (pid > 0) children.push_back(pid);
+    }
+
+    // Local workers that die are reported; their leases expire with their connections
+    int alive = (int)children.size();
+    auto reap = [&](int options) {
+        int status = 0;
+        pid_t pid;
+        while (alive > 0 && (pid = waitpid(-1, &status, options)) > 0) {
+            alive--;
+            if (WIFSIGNALED(status)) std::cout << "[coordinator] local worker (pid " << pid << ") killed by signal " << WTERMSIG(status) << std::endl;
+        }
+    };
+    coordinator.run([&] {
+        reap(WNOHANG);
+        // With only local workers and none left, nobody can settle the rest
+        return localWorkers == 0 || alive > 0 || coordinator.connectedWorkers() > 0;
+    });
+    reap(0);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> diff = end - start;
+
+    // --- FINAL STATS ---
+    int threads = 0, duplicates = 0, expired = 0;
+    for (const LeaseWorkerStats& w : coordinator.workers()) {
+        threads += w.threads;
+        duplicates += w.duplicates;
+        expired += w.expired;
+    }
+    std::cout << "\n===========================================" << std::endl;
+    std::cout << "   COMPLETED!" << std::endl;
+    std::cout << "   Images Processed: " << coordinator.settled(kItemDone) << std::endl;
+    std::cout << "   Threads Used:     " << threads << std::endl;
+    std::cout << "   TOTAL TIME:       " << diff.count() << " seconds" << std::endl;
+    std::cout << "   Leases:           " << coordinator.leasesGranted() << " granted, " << expired << " expired, "
+              << duplicates << " duplicate result(s), " << coordinator.settled(kItemFailed) << " failed, "
+              << coordinator.settled(kItemSkipped) << " skipped, " << coordinator.unsettled() << " never settled" << std::endl;
+    for (size_t w = 0; w < coordinator.workers().size(); ++w) {
+        const LeaseWorkerStats& s = coordinator.workers()[w];
+        int settled = s.images + s.failed + s.skipped;
+        std::cout << "     w" << w << " (" << s.host << ", " << s.threads << " threads): " << s.images << " image(s), "
+                  << s.leases << " lease(s), " << s.expired << " expired, "
+                  << (settled ? s.settleSeconds * 1000 / settled : 0.0) << " ms per file" << std::endl;
+    }
+    std::cout << "===========================================" << std::endl;
+
+    return coordinator.unsettled() == 0 ? 0 : 1;
+}
+
+// ==========================================
+// WATCHED INPUT FOLDER
+// ==========================================
+// Runs the batch loop on the backlog and then on every file that arrives, with the
+// workers and frame buffers kept between arrivals (see watch.h).
+inline int runWatch(Options opts, const std::string& label) {
+    namespace fs = std::filesystem;
+
+    if (!fs::exists(opts.inputFolder)) {
+        std::cout << "Error: Input folder '" << opts.inputFolder << "' not found." << std::endl;
+        return 1;
+    }
+    WatchSource source(opts.inputFolder, opts.settleMillis);
+    std::string error;
+    if (!source.start(error)) {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+    // Loader threads would wait for arrivals while holding the feed; files are claimed one at a time instead
+    if (opts.prefetch > 0) std::cout << "Note: --prefetch is not used with --watch" << std::endl;
+    opts.prefetch = 0;
+    std::cout << "Watching " << opts.inputFolder << ": " << source.backlog() << " file(s) in the backlog, new files taken "
+              << opts.settleMillis << " ms after they are written (Ctrl+C stops)" << std::endl;
+
+    int code = runBatch(opts, label, &source);
+    std::cout << "Watch stopped: " << source.backlog() << " backlog file(s), " << source.arrived() << " arrived while watching" << std::endl;
+    return code;
+}
+
+// ==========================================
+// STDIN/STDOUT STREAM
+// ==========================================
+// Runs the batch loop on the images framed on stdin and writes the results to
+// stdout in the same framing (see stream.h).
+inline int runStream(Options opts, const std::string& label) {
+    if (opts.stream != "frames" && opts.stream != "tar") {
+        std::cout << "Error: Unknown stream format '" << opts.stream << "' (use frames or tar)." << std::endl;
+        return 1;
+    }
+    // stdout carries the results, so the report goes to stderr
+    std::streambuf* console = std::cout.rdbuf(std::cerr.rdbuf());
+
+    // The reader thread frames images ahead of the batch loop; loader threads would wait on stdin while holding the feed
+    if (opts.prefetch > 0) std::cout << "Note: --prefetch is not used with --stream" << std::endl;
+    opts.prefetch = 0;
+    if (opts.saveOutput) std::cout << "Note: --save is not used with --stream (the results go to stdout)" << std::endl;
+    std::cout << "Streaming " << (opts.stream == "tar" ? "a tar archive" : "length-prefixed images")
+              << " from stdin to stdout" << std::endl;
+
+    StreamSource source(opts.stream == "tar");
+    source.start();
+    int code = runBatch(opts, label, &source);
+    bool ok = source.close();
+    std::cout << "Stream: " << source.imagesIn() << " image(s) in, " << source.resultsOut() << " result(s) out, "
+              << source.copiedThrough() << " member(s) copied through; "
+              << source.bytesRead() / 1048576.0 << " MB read, " << source.bytesWritten() / 1048576.0 << " MB written ("
+              << source.bytesSpliced() / 1048576.0 << " MB spliced)" << std::endl;
+    std::cout.rdbuf(console);
+    return code != 0 ? code : ok ? 0 : 1;
+}
+
+// ==========================================
+// UNIX-SOCKET DAEMON
+// ==========================================
+// Sets up the executor, the plan and the frame buffers once, then serves single
+// images until it is told to stop (see daemon.h).
+inline int runDaemon(Options opts, const std::string& label) {
+    ExecutionMode mode;
+    PageMode pageMode;
+    if (!setUpExecution(opts, mode, pageMode)) return 1;
+
+    ResourceLimits limits = detectResourceLimits();
+    if (opts.numThreads == 0) opts.numThreads = autoThreadCount(limits);
+    size_t budget = opts.memoryBudgetMB ? opts.memoryBudgetMB << 20 : memoryBudget(limits);
+    size_t bufferSize = frameBufferSize(mode, budget);
+
+    std::unique_ptr<Executor> exec = makeExecutor(opts.backend, opts.numThreads);
+    if (!exec) {
+        std::cout << "Error: Backend '" << opts.backend << "' is not available. Choose from:";
+        for (const auto& b : availableBackends()) std::cout << " " << b;
+        std::cout << std::endl;
+        return 1;
+    }
+    int pinned = 0;
+    if (opts.affinity != "none") pinned = pinWorkers(*exec, placeWorkers(discoverTopology(), opts.affinity, exec->threads()));
+
+    // The frame buffers are faulted in now, so the first request does not take the faults
+    std::vector<unsigned char*> buffers(executionBuffers(mode), nullptr);
+    for (auto& buf : buffers) {
+        buf = allocateFrame(bufferSize, pageMode);
+        if (!buf) {
+            std::cout << "Memory allocation failed!" << std::endl;
+            for (auto* b : buffers) releaseFrame(b);
+            return 1;
+        }
+        prefaultFrame(*exec, buf, bufferSize);
+    }
+
+    int code = 0;
+    {
+        ImageDaemon daemon(*exec, mode, buffers, bufferSize, opts.batch, opts.batchWindowMs);
+        std::string error;
+        if (!daemon.listen(opts.daemonSocket, error)) {
+            std::cout << "Error: " << error << std::endl;
+            code = 1;
+        } else {
+            // --- UI HEADER ---
+            std::cout << "===========================================" << std::endl;
+            std::cout << "   STARTING IMAGE DAEMON (" << exec->threads() << " Threads)" << std::endl;
+            std::cout << "   [" << label << ", backend: " << exec->name() << "]" << std::endl;
+            std::cout << "   Socket: " << opts.daemonSocket << std::endl;
+            if (opts.batch > 1) std::cout << "   Micro-batches: up to " << opts.batch << " requests, collected for up to " << opts.batchWindowMs << " ms"
+                                           << (mode.useSchedule || mode.dagTileRows > 0 || mode.planar ? " (this mode runs them one by one)" : "") << std::endl;
+            std::cout << "   Frame buffers: " << buffers.size() << " x " << (bufferSize >> 20) << " MB, " << pageModeName(pageMode) << " pages, prefaulted" << std::endl;
+            if (opts.affinity != "none") std::cout << "   Placement: " << opts.affinity << " (" << pinned << "/" << exec->threads() << " workers pinned)" << std::endl;
+            std::cout << "===========================================" << std::endl;
+
+            daemon.serve();
+
+            // --- FINAL STATS ---
+            std::cout << "\n===========================================" << std::endl;
+            std::cout << "   DAEMON STOPPED" << std::endl;
+            std::cout << "   Requests:         " << daemon.requests() << " (" << daemon.failures() << " failed)" << std::endl;
+            std::cout << "   Micro-batches:    " << daemon.batches() << " (" << daemon.meanBatch() << " images per batch)" << std::endl;
+            std::cout << "   Per image:        " << daemon.meanDecode() / 1000 << " ms decode, " << daemon.meanPipeline() / 1000
+                      << " ms pipeline (whole micro-batch), " << daemon.meanOutput() / 1000 << " ms output (means)" << std::endl;
+            for (int l = 0; l < kLaneCount; ++l) {
+                const DaemonLane& lane = daemon.lane(l);
+                std::cout << "     " << laneName(l) << ": " << lane.served << " served, peak queue " << lane.peakDepth << ", latency p50 "
+                          << percentile(lane.latencies, 0.50) / 1000.0 << " ms, p99 " << percentile(lane.latencies, 0.99) / 1000.0 << " ms" << std::endl;
+            }
+            std::cout << "   Decoder arena:    " << describeArenaStats() << std::endl;
+            std::cout << "===========================================" << std::endl;
+        }
+    }
+    for (auto* buf : buffers) releaseFrame(buf);
+    return code;
+}
+
+#endif // CST435_DRIVER_H
@@ -0,0 +1,328 @@
+/**
+ * @file executor.h
+ * @brief Pluggable "parallel range" executors shared by every implementation
+ * @course CST435: Parallel Computing
+ *
+ * Every filter kernel is written against a row range [startRow, endRow).
+ * An Executor decides how the rows [0, n) of a stage are split across
+ * workers, so the same kernels can be timed under different backends:
+ *   - serial   : single thread, no synchronisation (baseline)
+ *   - threads  : persistent std::thread pool with a static row split
+ *   - openmp   : OpenMP parallel region with a static row split
+ *   - steal    : std::thread pool with lock-free work-stealing row chunks
+ *
+ * Every backend only cuts [0, n) at multiples of 'grain' (except at n), so a
+ * caller that picks the grain from the frame's row size (see alignedRowGrain()
+ * in pipeline.h) keeps two workers from ever writing the same cache line.
+ */
+
+#ifndef CST435_EXECUTOR_H
+#define CST435_EXECUTOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// ==========================================
+//            EXECUTOR INTERFACE
+// ==========================================
+class Executor {
+public:
+    virtual ~Executor() = default;
+
+    virtual const char* name() const = 0;
+    virtual int threads() const = 0;
+
+    // Calls body(begin, end) on disjoint sub-ranges that together cover [0, n).
+    // Sub-ranges start at multiples of 'grain', the smallest unit worth handing out.
+    // Returns only after every sub-range has finished (acts as the stage barrier).
+    virtual void parallelFor(int n, const std::function<void(int, int)>& body, int grain = 1) = 0;
+
+    // Calls fn(workerId) exactly once on each worker thread (e.g. to pin it to a CPU).
+    virtual void forEachWorker(const std::function<void(int)>& fn) = 0;
+};
+
+// Static split identical to the original runParallel(): worker i gets
+// rows [i * n / parts, (i + 1) * n / parts), the last one takes the remainder.
+// With quantum > 1 the split is made in whole units of 'quantum' rows instead,
+// spread as evenly as possible.
+inline void staticRange(int n, int parts, int index, int& begin, int& end, int quantum = 1) {
+    if (quantum <= 1) {
+        int rowsPerPart = n / parts;
+        begin = index * rowsPerPart;
+        end = (index == parts - 1) ? n : (index + 1) * rowsPerPart;
+        return;
+    }
+    long units = (n + quantum - 1) / quantum;
+    begin = (int)std::min<long>(n, index * units / parts * quantum);
+    end = (int)std::min<long>(n, (index + 1) * units / parts * quantum);
+}
+
+// ==========================================
+//          SERIAL BACKEND (BASELINE)
+// ==========================================
+class SerialExecutor : public Executor {
+public:
+    const char* name() const override { return "serial"; }
+    int threads() const override { return 1; }
+
+    void parallelFor(int n, const std::function<void(int, int)>& body, int) override {
+        if (n > 0) body(0, n);
+    }
+
+    void forEachWorker(const std::function<void(int)>& fn) override { fn(0); }
+};
+
+// ==========================================
+//        PERSISTENT WORKER POOL (HELPER)
+// ==========================================
+// Threads are created once and parked on a condition variable between stages,
+// instead of spawning and joining numThreads threads for every filter.
+// The calling thread acts as worker 0, so a pool of N uses N - 1 extra threads.
+class WorkerPool {
+public:
+    explicit WorkerPool(int numThreads) : size_(numThreads < 1 ? 1 : numThreads) {
+        for (int id = 1; id < size_; ++id) {
+            workers_.emplace_back([this, id] { workerLoop(id); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            ++generation_;
+        }
+        wake_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int size() const { return size_; }
+
+    // Runs job(workerId) once on every worker and waits for all of them.
+    void run(const std::function<void(int)>& job) {
+        if (size_ == 1) { job(0); return; }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            pending_ = size_ - 1;
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        job(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return pending_ == 0; });
+        job_ = nullptr;
+    }
+
+private:
+    void workerLoop(int id) {
+        uint64_t seen = 0;
+        for (;;) {
+            const std::function<void(int)>* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return generation_ != seen; });
+                seen = generation_;
+                if (stopping_) return;
+                job = job_;
+            }
+            (*job)(id);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--pending_ == 0) done_.notify_one();
+            }
+        }
+    }
+
+    int size_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(int)>* job_ = nullptr;
+    uint64_t generation_ = 0;
+    int pending_ = 0;
+    bool stopping_ = false;
+};
+
+// ==========================================
+//      STD::THREAD BACKEND (STATIC SPLIT)
+// ==========================================
+class ThreadPoolExecutor : public Executor {
+public:
+    explicit ThreadPoolExecutor(int numThreads) : pool_(numThreads) {}
+
+    const char* name() const override { return "threads"; }
+    int threads() const override { return pool_.size(); }
+
+    void parallelFor(int n, const std::function<void(int, int)>& body, int grain) override {
+        int parts = pool_.size();
+        pool_.run([&](int id) {
+            int begin, end;
+            staticRange(n, parts, id, begin, end, grain);
+            if (begin < end) body(begin, end);
+        });
+    }
+
+    void forEachWorker(const std::function<void(int)>& fn) override { pool_.run(fn); }
+
+private:
+    WorkerPool pool_;
+};
+
+// ==========================================
+//        OPENMP BACKEND (STATIC SPLIT)
+// ==========================================
+#ifdef _OPENMP
+class OpenMPExecutor : public Executor {
+public:
+    explicit OpenMPExecutor(int numThreads) : numThreads_(numThreads < 1 ? 1 : numThreads) {}
+
+    const char* name() const override { return "openmp"; }
+    int threads() const override { return numThreads_; }
+
+    void parallelFor(int n, const std::function<void(int, int)>& body, int grain) override {
+        // One contiguous block of rows per thread, like schedule(static)
+        #pragma omp parallel num_threads(numThreads_)
+        {
+            int begin, end;
+            staticRange(n, omp_get_num_threads(), omp_get_thread_num(), begin, end, grain);
+            if (begin < end) body(begin, end);
+        }
+    }
+
+    // The OpenMP runtime keeps the same team threads between regions of the same size
+    void forEachWorker(const std::function<void(int)>& fn) override {
+        #pragma omp parallel num_threads(numThreads_)
+        fn(omp_get_thread_num());
+    }
+
+private:
+    int numThreads_;
+};
+#endif
+
+// ==========================================
+//        WORK-STEALING BACKEND (DYNAMIC)
+// ==========================================
+// Rows are cut into chunks of 'grain' rows. Each worker starts with a contiguous
+// block of chunks stored as a packed [lo, hi) pair in one atomic word. The owner
+// pops chunks from the front; an idle worker steals the back half of a victim's
+// range with a single CAS, so no locks are taken on the hot path.
+class WorkStealingExecutor : public Executor {
+public:
+    explicit WorkStealingExecutor(int numThreads)
+        : pool_(numThreads), ranges_(new Slot[pool_.size()]) {}
+
+    const char* name() const override { return "steal"; }
+    int threads() const override { return pool_.size(); }
+
+    void parallelFor(int n, const std::function<void(int, int)>& body, int grain) override {
+        if (grain < 1) grain = 1;
+        int parts = pool_.size();
+        int chunks = (n + grain - 1) / grain;
+
+        for (int i = 0; i < parts; ++i) {
+            int lo, hi;
+            staticRange(chunks, parts, i, lo, hi);
+            ranges_[i].range.store(pack(lo, hi), std::memory_order_relaxed);
+        }
+
+        pool_.run([&](int id) {
+            auto runChunk = [&](uint32_t chunk) {
+                int begin = (int)chunk * grain;
+                int end = std::min(n, begin + grain);
+                body(begin, end);
+            };
+
+            uint32_t chunk;
+            for (;;) {
+                while (popFront(id, chunk)) runChunk(chunk);
+                if (!stealHalf(id, parts)) break;
+            }
+        });
+    }
+
+    void forEachWorker(const std::function<void(int)>& fn) override { pool_.run(fn); }
+
+private:
+    struct alignas(64) Slot { std::atomic<uint64_t> range{0}; };
+
+    static uint64_t pack(uint32_t lo, uint32_t hi) { return ((uint64_t)lo << 32) | hi; }
+    static uint32_t lo(uint64_t r) { return (uint32_t)(r >> 32); }
+    static uint32_t hi(uint64_t r) { return (uint32_t)r; }
+
+    bool popFront(int id, uint32_t& chunk) {
+        std::atomic<uint64_t>& slot = ranges_[id].range;
+        uint64_t r = slot.load(std::memory_order_acquire);
+        while (lo(r) < hi(r)) {
+            if (slot.compare_exchange_weak(r, pack(lo(r) + 1, hi(r)), std::memory_order_acq_rel)) {
+                chunk = lo(r);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Moves the back half of some victim's range into our own (empty) slot.
+    bool stealHalf(int id, int parts) {
+        for (int k = 1; k < parts; ++k) {
+            int victim = (id + k) % parts;
+            std::atomic<uint64_t>& slot = ranges_[victim].range;
+            uint64_t r = slot.load(std::memory_order_acquire);
+            while (lo(r) < hi(r)) {
+                uint32_t mid = lo(r) + (hi(r) - lo(r)) / 2;
+                if (slot.compare_exchange_weak(r, pack(lo(r), mid), std::memory_order_acq_rel)) {
+                    ranges_[id].range.store(pack(mid, hi(r)), std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    WorkerPool pool_;
+    std::unique_ptr<Slot[]> ranges_;
+};
+
+// ==========================================
+//              BACKEND FACTORY
+// ==========================================
+inline std::vector<std::string> availableBackends() {
+    std::vector<std::string> names = {"serial", "threads"};
+#ifdef _OPENMP
+    names.push_back("openmp");
+#endif
+    names.push_back("steal");
+    return names;
+}
+
+// Returns nullptr if the backend is unknown or not compiled into this binary.
+inline std::unique_ptr<Executor> makeExecutor(const std::string& backend, int numThreads) {
+    if (backend == "serial") return std::unique_ptr<Executor>(new SerialExecutor());
+    if (backend == "threads") return std::unique_ptr<Executor>(new ThreadPoolExecutor(numThreads));
+#ifdef _OPENMP
+    if (backend == "openmp") return std::unique_ptr<Executor>(new OpenMPExecutor(numThreads));
+#endif
+    if (backend == "steal") return std::unique_ptr<Executor>(new WorkStealingExecutor(numThreads));
+    return nullptr;
+}
+
+#endif // CST435_EXECUTOR_H
@@ -0,0 +1,382 @@
+/**
+ * @file filters.h
+ * @brief The five image filters, shared by the OpenMP and std::thread builds
+ * @course CST435: Parallel Computing
+ *
+ * Every kernel processes the rows [startRow, endRow) of an interleaved
+ * 8-bit image and never touches other rows of the output, so any Executor
+ * can split a stage into independent row ranges.
+ *
+ * Stencils (convolution, Sobel) compute every output pixel: samples outside
+ * the image are read through a Border rule (clamp, mirror, wrap, constant).
+ * Interior pixels run a branch-free loop; only the 1-pixel frame around the
+ * image takes the peeled path that applies the rule.
+ */
+
+#ifndef CST435_FILTERS_H
+#define CST435_FILTERS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// ==========================================
+// PER-PIXEL DEFINITIONS (THE ALGORITHM)
+// ==========================================
+// Each filter is defined once as a function of its input samples. 'p' points at
+// channel c of the pixel being computed in the input image; neighbours are at
+// p +/- channels (left/right) and p +/- stride (up/down), so the same definition
+// works on full frames and on the tile scratch buffers used by schedule.h.
+
+// Grayscale: Y = 0.299R + 0.587G + 0.114B, alpha (c == 3) is copied
+inline unsigned char grayscalePixel(const unsigned char* px, int c) {
+    if (c == 3) return px[3];
+    return (unsigned char)(0.299f * px[0] + 0.587f * px[1] + 0.114f * px[2]);
+}
+
+// 3x3 convolution of one channel, clamped to [0, 255]
+inline unsigned char convolvePixel(const unsigned char* p, int stride, int channels, const float kernel[3][3]) {
+    float sum = 0.0f;
+    for (int ky = -1; ky <= 1; ++ky) {
+        for (int kx = -1; kx <= 1; ++kx) {
+            sum += p[ky * stride + kx * channels] * kernel[ky + 1][kx + 1];
+        }
+    }
+    return (unsigned char)std::max(0.0f, std::min(255.0f, sum));
+}
+
+// Sobel gradient magnitude of one channel
+inline unsigned char sobelPixel(const unsigned char* p, int stride, int channels) {
+    static const int gx[3][3] = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};
+    static const int gy[3][3] = {{-1, -2, -1}, {0, 0, 0}, {1, 2, 1}};
+    float sumX = 0.0f, sumY = 0.0f;
+    for (int ky = -1; ky <= 1; ++ky) {
+        for (int kx = -1; kx <= 1; ++kx) {
+            int v = p[ky * stride + kx * channels];
+            sumX += v * gx[ky + 1][kx + 1];
+            sumY += v * gy[ky + 1][kx + 1];
+        }
+    }
+    int magnitude = (int)std::sqrt(sumX * sumX + sumY * sumY);
+    return (unsigned char)std::max(0, std::min(255, magnitude));
+}
+
+// Brightness offset of one sample, clamped to [0, 255]
+inline unsigned char brightnessPixel(unsigned char v, int value) {
+    return (unsigned char)std::max(0, std::min(255, v + value));
+}
+
+// Contrast stretch around mid-gray: (v - 128) * factor + 128
+inline unsigned char contrastPixel(unsigned char v, float factor) {
+    float r = std::round((v - 128) * factor + 128.0f);
+    return (unsigned char)std::max(0.0f, std::min(255.0f, r));
+}
+
+// Gamma correction: 255 * (v / 255) ^ (1 / gamma)
+inline unsigned char gammaPixel(unsigned char v, float gamma) {
+    float r = std::round(255.0f * std::pow(v / 255.0f, 1.0f / gamma));
+    return (unsigned char)std::max(0.0f, std::min(255.0f, r));
+}
+
+// Binary threshold: 255 at or above the level, 0 below
+inline unsigned char thresholdPixel(unsigned char v, int level) {
+    return v >= level ? 255 : 0;
+}
+
+// ==========================================
+//           NON-TEMPORAL OUTPUT
+// ==========================================
+// Frames larger than the last-level cache are evicted before the next stage reads
+// them, so writing them through the cache only costs a read-for-ownership of every
+// output line. With 'stream' set, point kernels produce kStreamBlockBytes at a time
+// into an L1-resident block and copy it out with non-temporal stores, prefetching
+// the next block's input meanwhile. The threshold is chosen in pipeline.h.
+const size_t kStreamBlockBytes = 4096;
+
+// Copies n bytes with 16-byte non-temporal stores (the unaligned head and tail use normal stores).
+inline void streamStore(unsigned char* dst, const unsigned char* src, size_t n) {
+#if defined(__x86_64__) || defined(__i386__)
+    size_t i = std::min(n, (size_t)(-(uintptr_t)dst & 15));
+    std::memcpy(dst, src, i);
+    for (; i + 16 <= n; i += 16) _mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+    std::memcpy(dst + i, src + i, n - i);
+#else
+    std::memcpy(dst, src, n);
+#endif
+}
+
+// Runs 'produce(in, out, count)' over the n-byte span block by block (blocks hold whole
+// 'unit'-byte pixels) and streams each block to 'out'. Works in place (in == out).
+template <typename Produce>
+inline void streamSpan(const unsigned char* in, unsigned char* out, size_t n, size_t unit, Produce produce) {
+#if defined(__x86_64__) || defined(__i386__)
+    alignas(64) unsigned char block[kStreamBlockBytes];
+    size_t step = kStreamBlockBytes / unit * unit;
+    for (size_t off = 0; off < n; off += step) {
+        size_t count = std::min(step, n - off);
+        for (size_t p = off + step; p < std::min(n, off + 2 * step); p += 64) _mm_prefetch((const char*)(in + p), _MM_HINT_NTA);
+        produce(in + off, block, count);
+        streamStore(out + off, block, count);
+    }
+    _mm_sfence();   // order the weakly-ordered stores before the step's barrier
+#else
+    (void)unit;
+    produce(in, out, n);
+#endif
+}
+
+// ==========================================
+// IMAGE FILTER FUNCTIONS (ROW KERNELS)
+// ==========================================
+
+// 1. Grayscale Conversion: RGB -> Gray, over n bytes of whole pixels
+inline void grayscaleSpan(const unsigned char* in, unsigned char* out, size_t n, int channels) {
+    for (size_t i = 0; i < n; i += channels) {
+        unsigned char gray = grayscalePixel(in + i, 0);
+
+        out[i] = gray;
+        out[i + 1] = gray;
+        out[i + 2] = gray;
+        if (channels == 4) out[i + 3] = in[i + 3];
+    }
+}
+
+inline void applyGrayscale(const unsigned char* input, unsigned char* output, int width, int height, int channels, int startRow, int endRow, bool stream = false) {
+    (void)height;
+    size_t begin = (size_t)startRow * width * channels;
+    size_t n = (size_t)(endRow - startRow) * width * channels;
+    if (channels < 3) {
+        // Already single-channel (or gray + alpha): pass the rows through unchanged
+        if (input == output) return;
+        if (stream) { streamStore(output + begin, input + begin, n); return; }
+        std::memcpy(output + begin, input + begin, n);
+        return;
+    }
+    if (stream) {
+        streamSpan(input + begin, output + begin, n, channels, [&](const unsigned char* in, unsigned char* out, size_t count) { grayscaleSpan(in, out, count, channels); });
+        return;
+    }
+    grayscaleSpan(input + begin, output + begin, n, channels);
+}
+
+// ==========================================
+//              BORDER HANDLING
+// ==========================================
+// clamp    : aaa|abcd|ddd   (repeat the edge sample)
+// mirror   : cb|abcd|cb     (reflect around the edge sample, which is not repeated)
+// wrap     : cd|abcd|ab     (the image tiles the plane)
+// constant : vv|abcd|vv     (a fixed value)
+enum class BorderMode { Clamp, Mirror, Wrap, Constant };
+
+struct Border {
+    BorderMode mode = BorderMode::Clamp;
+    unsigned char value = 0;          // used by BorderMode::Constant
+};
+
+// Maps coordinate i (at most one step outside [0, n)) into the image.
+// Returns -1 for a constant border sample.
+inline int borderCoord(int i, int n, BorderMode mode) {
+    if (i >= 0 && i < n) return i;
+    switch (mode) {
+        case BorderMode::Clamp:    return i < 0 ? 0 : n - 1;
+        case BorderMode::Mirror:   return n == 1 ? 0 : (i < 0 ? 1 : n - 2);
+        case BorderMode::Wrap:     return i < 0 ? n - 1 : 0;
+        case BorderMode::Constant: return -1;
+    }
+    return -1;
+}
+
+// Gathers the 3x3 neighbourhood of channel c at (x, y) into 'win' (row-major) through
+// the border rule, so a per-pixel definition can run on it with stride 3, channels 1.
+// Pixel (x, y) of the image starts at base + y * stride + x * channels.
+inline void gatherWindow(const unsigned char* base, int stride, int width, int height, int channels, int x, int y, int c, const Border& border, unsigned char win[9]) {
+    for (int ky = -1; ky <= 1; ++ky) {
+        int sy = borderCoord(y + ky, height, border.mode);
+        for (int kx = -1; kx <= 1; ++kx) {
+            int sx = borderCoord(x + kx, width, border.mode);
+            win[(ky + 1) * 3 + kx + 1] = (sx < 0 || sy < 0) ? border.value : base[(size_t)sy * stride + (size_t)sx * channels + c];
+        }
+    }
+}
+
+// Peeled path: the image border pixels of rows [startRow, endRow) (all of row 0 and
+// row height-1, the first and last column elsewhere). 'fn(p, stride, channels)' is a
+// per-pixel stencil definition such as convolvePixel or sobelPixel.
+template <typename StencilFn>
+inline void applyStencilBorder(const unsigned char* input, unsigned char* output, int stride, int width, int height, int channels, int startRow, int endRow, const Border& border, StencilFn fn) {
+    auto borderPixel = [&](int x, int y) {
+        unsigned char win[9];
+        for (int c = 0; c < channels; ++c) {
+            gatherWindow(input, stride, width, height, channels, x, y, c, border, win);
+            output[(size_t)y * stride + (size_t)x * channels + c] = fn(win + 4, 3, 1);
+        }
+    };
+    auto borderRow = [&](int y) { for (int x = 0; x < width; ++x) borderPixel(x, y); };
+
+    if (startRow == 0) borderRow(0);
+    if (endRow == height && height > 1) borderRow(height - 1);
+    for (int y = std::max(startRow, 1); y < std::min(endRow, height - 1); ++y) {
+        borderPixel(0, y);
+        if (width > 1) borderPixel(width - 1, y);
+    }
+}
+
+// Interior rows run one unit-step loop over the samples of columns [1, width - 1),
+// with neighbours at +/- channels and +/- stride and no bounds checks.
+template <typename StencilFn>
+inline void applyStencil(const unsigned char* input, unsigned char* output, int stride, int width, int height, int channels, int startRow, int endRow, const Border& border, StencilFn fn) {
+    for (int y = std::max(startRow, 1); y < std::min(endRow, height - 1); ++y) {
+        const unsigned char* p = input + (size_t)y * stride;
+        unsigned char* o = output + (size_t)y * stride;
+        for (int i = channels; i < (width - 1) * channels; ++i) o[i] = fn(p + i, stride, channels);
+    }
+    applyStencilBorder(input, output, stride, width, height, channels, startRow, endRow, border, fn);
+}
+
+// Helper for Convolution (Used by Blur, Sharpen)
+inline void applyConvolution(const unsigned char* input, unsigned char* output, int width, int height, int channels, const float kernel[3][3], int startRow, int endRow, const Border& border) {
+    applyStencil(input, output, width * channels, width, height, channels, startRow, endRow, border,
+                 [kernel](const unsigned char* p, int stride, int ch) { return convolvePixel(p, stride, ch, kernel); });
+}
+
+// 3x3 kernels selectable from the pipeline spec (e.g. "blur:box", "sharpen:full")
+static const float kGaussianKernel[3][3] = {
+    {1/16.0f, 2/16.0f, 1/16.0f},
+    {2/16.0f, 4/16.0f, 2/16.0f},
+    {1/16.0f, 2/16.0f, 1/16.0f}
+};
+static const float kBoxKernel[3][3] = {
+    {1/9.0f, 1/9.0f, 1/9.0f},
+    {1/9.0f, 1/9.0f, 1/9.0f},
+    {1/9.0f, 1/9.0f, 1/9.0f}
+};
+static const float kSharpenCrossKernel[3][3] = {
+    { 0, -1,  0},
+    {-1,  5, -1},
+    { 0, -1,  0}
+};
+static const float kSharpenFullKernel[3][3] = {
+    {-1, -1, -1},
+    {-1,  9, -1},
+    {-1, -1, -1}
+};
+
+// 2. Gaussian Blur (3x3 Kernel)
+inline void applyBlur(const unsigned char* input, unsigned char* output, int width, int height, int channels, int startRow, int endRow, const Border& border) {
+    applyConvolution(input, output, width, height, channels, kGaussianKernel, startRow, endRow, border);
+}
+
+// 3. Sharpening (3x3 Kernel)
+inline void applySharpen(const unsigned char* input, unsigned char* output, int width, int height, int channels, int startRow, int endRow, const Border& border) {
+    applyConvolution(input, output, width, height, channels, kSharpenCrossKernel, startRow, endRow, border);
+}
+
+// 4. Edge Detection (Sobel Operator)
+inline void applyEdge(const unsigned char* input, unsigned char* output, int width, int height, int channels, int startRow, int endRow, const Border& border) {
+    applyStencil(input, output, width * channels, width, height, channels, startRow, endRow, border, sobelPixel);
+}
+
+// 5. Brightness Adjustment (alpha channel is copied, not brightened)
+inline void brightnessSpan(const unsigned char* in, unsigned char* out, size_t n, int channels, int value) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = (channels == 4 && i % 4 == 3) ? in[i] : brightnessPixel(in[i], value);
+    }
+}
+
+inline void applyBrightness(const unsigned char* input, unsigned char* output, int width, int height, int channels, int value, int startRow, int endRow, bool stream = false) {
+    (void)height;
+    size_t begin = (size_t)startRow * width * channels;
+    size_t n = (size_t)(endRow - startRow) * width * channels;
+    if (stream) {
+        streamSpan(input + begin, output + begin, n, channels, [&](const unsigned char* in, unsigned char* out, size_t count) { brightnessSpan(in, out, count, channels, value); });
+        return;
+    }
+    brightnessSpan(input + begin, output + begin, n, channels, value);
+}
+
+// 6. Lookup table (a composed chain of per-byte tone stages, see pipeline.h)
+// The 256-entry table is split into 16 rows of 16 bytes; for every input byte the
+// low nibble selects the column with pshufb and the high nibble selects which
+// row's result is kept, so 32 (AVX2) or 16 (SSSE3) bytes are mapped per step.
+// In 4-channel images the alpha byte of every pixel is copied unchanged.
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+inline size_t lookupSpanAvx2(const unsigned char* in, unsigned char* out, size_t n, const unsigned char* lut, bool keepAlpha) {
+    __m256i rows[16];
+    for (int k = 0; k < 16; ++k) rows[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(lut + 16 * k)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i alpha = keepAlpha ? _mm256_set1_epi32((int)0xff000000) : _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+        __m256i lo = _mm256_and_si256(v, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+        __m256i r = _mm256_setzero_si256();
+        for (int k = 0; k < 16; ++k) {
+            __m256i hit = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8((char)k));
+            r = _mm256_or_si256(r, _mm256_and_si256(hit, _mm256_shuffle_epi8(rows[k], lo)));
+        }
+        r = _mm256_or_si256(_mm256_andnot_si256(alpha, r), _mm256_and_si256(alpha, v));
+        _mm256_storeu_si256((__m256i*)(out + i), r);
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+inline size_t lookupSpanSsse3(const unsigned char* in, unsigned char* out, size_t n, const unsigned char* lut, bool keepAlpha) {
+    __m128i rows[16];
+    for (int k = 0; k < 16; ++k) rows[k] = _mm_loadu_si128((const __m128i*)(lut + 16 * k));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i alpha = keepAlpha ? _mm_set1_epi32((int)0xff000000) : _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i lo = _mm_and_si128(v, nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+        __m128i r = _mm_setzero_si128();
+        for (int k = 0; k < 16; ++k) {
+            __m128i hit = _mm_cmpeq_epi8(hi, _mm_set1_epi8((char)k));
+            r = _mm_or_si128(r, _mm_and_si128(hit, _mm_shuffle_epi8(rows[k], lo)));
+        }
+        r = _mm_or_si128(_mm_andnot_si128(alpha, r), _mm_and_si128(alpha, v));
+        _mm_storeu_si128((__m128i*)(out + i), r);
+    }
+    return i;
+}
+#endif
+
+// n bytes starting at a pixel boundary
+inline void lookupSpan(const unsigned char* in, unsigned char* out, size_t n, const unsigned char* lut, bool keepAlpha) {
+    size_t done = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    static const int simd = __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("ssse3") ? 1 : 0;
+    if (simd == 2) done = lookupSpanAvx2(in, out, n, lut, keepAlpha);
+    else if (simd == 1) done = lookupSpanSsse3(in, out, n, lut, keepAlpha);
+#endif
+    // Scalar tail (and fallback); 'done' is a multiple of 4 so i % 4 is the channel
+    for (size_t i = done; i < n; ++i) {
+        out[i] = (keepAlpha && i % 4 == 3) ? in[i] : lut[in[i]];
+    }
+}
+
+inline void applyLookupTable(const unsigned char* input, unsigned char* output, int width, int height, int channels, const unsigned char* lut, int startRow, int endRow, bool stream = false) {
+    (void)height;
+    size_t begin = (size_t)startRow * width * channels;
+    size_t n = (size_t)(endRow - startRow) * width * channels;
+    bool keepAlpha = (channels == 4);
+    if (stream) {
+        streamSpan(input + begin, output + begin, n, channels, [&](const unsigned char* in, unsigned char* out, size_t count) { lookupSpan(in, out, count, lut, keepAlpha); });
+        return;
+    }
+    lookupSpan(input + begin, output + begin, n, lut, keepAlpha);
+}
+
+#endif // CST435_FILTERS_H
@@ -0,0 +1,154 @@
+/**
+ * @file jit.h
+ * @brief Runtime-specialised convolution kernels with an on-disk code cache
+ * @course CST435: Parallel Computing
+ *
+ * applyConvolution() is generic: it reloads all nine coefficients for every
+ * sample, multiplies by zeros and walks the channels in a strided inner loop.
+ * With --jit, every blur/sharpen/convolve stage gets a row kernel generated as
+ * C++ source with its coefficients, channel count and the host's SIMD tier
+ * baked in:
+ *   - the x/channel loops become one unit-stride loop over samples (neighbours
+ *     are +/- channels away), which the compiler auto-vectorises
+ *   - zero coefficients disappear and the rest are literal constants
+ * The source is compiled with the system compiler into a shared object and
+ * loaded with dlopen. Objects are cached on disk under a hash of the source
+ * and compiler command, so later runs only pay the dlopen.
+ *
+ * The generated code keeps applyConvolution's evaluation order and disables
+ * FMA contraction, so results are bit-identical to the generic kernel.
+ */
+
+#ifndef CST435_JIT_H
+#define CST435_JIT_H
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "pipeline.h"
+
+// Stable 64-bit FNV-1a hash as 16 hex digits (used for cache and profile names).
+inline std::string fnv1aHex(const std::string& text) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char ch : text) { h ^= ch; h *= 1099511628211ull; }
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+    return buf;
+}
+
+// Highest instruction set the generated code may use on this CPU.
+inline std::string simdTierFlags() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) return "-mavx512f -mavx512bw -mavx2";
+    if (__builtin_cpu_supports("avx2")) return "-mavx2";
+    if (__builtin_cpu_supports("sse4.1")) return "-msse4.1";
+#endif
+    return "";
+}
+
+// C++ source of a row kernel for one 3x3 kernel and channel count.
+inline std::string generateKernelSource(const float kernel[3][3], int channels) {
+    std::string src;
+    src += "// Generated by src_common/jit.h - do not edit\n";
+    src += "extern \"C\" void cst435_kernel(const unsigned char* input, unsigned char* output, int width, int height, int startRow, int endRow) {\n";
+    src += "    const int C = " + std::to_string(channels) + ";\n";
+    src += "    const int stride = width * C;\n";
+    src += "    int y0 = startRow < 1 ? 1 : startRow;\n";
+    src += "    int y1 = endRow < height - 1 ? endRow : height - 1;\n";
+    src += "    for (int y = y0; y < y1; ++y) {\n";
+    src += "        const unsigned char* r0 = input + (long)(y - 1) * stride;\n";
+    src += "        const unsigned char* r1 = r0 + stride;\n";
+    src += "        const unsigned char* r2 = r1 + stride;\n";
+    src += "        unsigned char* o = output + (long)y * stride;\n";
+    src += "        #pragma GCC ivdep\n";
+    src += "        for (int i = C; i < (width - 1) * C; ++i) {\n";
+    src += "            float sum = 0.0f;\n";
+    for (int ky = 0; ky < 3; ++ky) {
+        for (int kx = 0; kx < 3; ++kx) {
+            float k = kernel[ky][kx];
+            if (k == 0.0f) continue;   // adding 0 * x would not change 'sum'
+            char coeff[32];
+            std::snprintf(coeff, sizeof(coeff), "%af", k);  // exact hex float literal
+            std::string offset = kx == 0 ? " - C" : kx == 2 ? " + C" : "";
+            src += "            sum += r" + std::to_string(ky) + "[i" + offset + "] * " + coeff + ";\n";
+        }
+    }
+    src += "            o[i] = (unsigned char)(sum < 0.0f ? 0.0f : (sum > 255.0f ? 255.0f : sum));\n";
+    src += "        }\n";
+    src += "    }\n";
+    src += "}\n";
+    return src;
+}
+
+// Returns the compiled kernel, building it into 'cacheDir' if it is not cached yet.
+// Returns nullptr (and fills 'error') if compiling or loading fails.
+inline JitKernelFn loadJitKernel(const float kernel[3][3], int channels, const std::string& cacheDir, std::string& error) {
+    namespace fs = std::filesystem;
+    static std::mutex mutex;
+    static std::map<std::string, JitKernelFn> loaded;   // handles stay open for the process lifetime
+
+    const char* envCompiler = std::getenv("CXX");
+    std::string compiler = envCompiler ? envCompiler : "c++";
+    std::string flags = "-O3 -shared -fPIC -ffp-contract=off " + simdTierFlags();
+    std::string source = generateKernelSource(kernel, channels);
+    std::string hash = fnv1aHex(compiler + "\n" + flags + "\n" + source);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = loaded.find(hash);
+    if (it != loaded.end()) return it->second;
+
+    std::error_code ec;
+    fs::create_directories(cacheDir, ec);
+    std::string base = cacheDir + "/k_" + hash;
+    std::string library = base + ".so";
+
+    if (!fs::exists(library)) {
+        // Write, compile and log under private names, then rename into place, so concurrent
+        // processes never compile or load each other's partial files
+        std::string own = base + "." + std::to_string(getpid());
+        std::ofstream(own + ".cpp") << source;
+        std::string temp = own + ".tmp.so";
+        std::string cmd = compiler + " " + flags + " '" + own + ".cpp' -o '" + temp + "' 2> '" + own + ".log'";
+        if (std::system(cmd.c_str()) != 0) {
+            error = "compiling " + own + ".cpp failed (see " + own + ".log)";
+            return nullptr;
+        }
+        fs::remove(own + ".log", ec);
+        fs::rename(own + ".cpp", base + ".cpp", ec);
+        fs::rename(temp, library, ec);
+        if (ec) { error = "cannot move " + temp + " into the cache: " + ec.message(); return nullptr; }
+    }
+
+    void* handle = dlopen(fs::absolute(library).c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) { error = std::string("dlopen failed: ") + dlerror(); return nullptr; }
+    JitKernelFn fn = (JitKernelFn)dlsym(handle, "cst435_kernel");
+    if (!fn) { error = "symbol cst435_kernel missing in " + library; return nullptr; }
+
+    loaded[hash] = fn;
+    return fn;
+}
+
+// Attaches specialised kernels (for 1-4 channels) to every convolution stage.
+inline bool specializeStages(std::vector<StageSpec>& stages, const std::string& cacheDir, std::string& error) {
+    for (StageSpec& stage : stages) {
+        if (stage.kind != StageKind::Blur && stage.kind != StageKind::Sharpen && stage.kind != StageKind::Convolve) continue;
+        for (int channels = 1; channels <= 4; ++channels) {
+            stage.jit[channels] = loadJitKernel(stage.kernel, channels, cacheDir, error);
+            if (!stage.jit[channels]) return false;
+        }
+    }
+    return true;
+}
+
+#endif // CST435_JIT_H
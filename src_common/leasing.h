@@ -0,0 +1,420 @@
+/**
+ * @file leasing.h
+ * @brief Work-leasing coordinator and workers over TCP (--coordinate / --worker)
+ * @course CST435: Parallel Computing
+ *
+ * A lighter alternative to MPI for elastic pools, where preemptible VMs join
+ * and disappear mid-batch. The coordinator scans the input folder and hands
+ * out leases on batches of --lease-size files; a worker runs the normal batch
+ * loop on the files of its leases and
+ *   - renews its open leases from a heartbeat thread every third of the
+ *     coordinator's --lease-seconds, so a long image does not let them lapse
+ *   - streams one METRIC line per settled file (its state and the time from
+ *     claim to settle) back to the coordinator
+ * A lease that is not renewed in time, or whose worker disconnects, expires:
+ * its unsettled files go back to the front of the queue, and the old holder
+ * learns on its next renewal that the lease is LOST and drops the files it
+ * has not started. A result for a file someone else already settled is
+ * counted as a duplicate and ignored.
+ *
+ * The protocol is line-based text, one TCP connection per worker:
+ *   HELLO host threads       -> WELCOME workerId leaseMillis
+ *   LEASE                    -> GRANT leaseId n, then n lines "id readable width height channels path"
+ *                               | WAIT millis (every file is leased, some leases may still expire)
+ *                               | DONE
+ *   RENEW leaseId            -> OK | LOST
+ *   METRIC leaseId id state micros   (no reply; state is done, failed or skipped)
+ * Files are opened by path, so workers on other VMs need the folder at the
+ * same path (a shared filesystem). --local-workers=N forks N workers that
+ * connect over localhost.
+ */
+
+#ifndef CST435_LEASING_H
+#define CST435_LEASING_H
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "admission.h"
+#include "sockets.h"
+
+const int kLeaseWaitMillis = 200;      // WAIT hint when every file is out on a lease
+const int kCoordinatorTickMillis = 100;
+
+// A file's coordinator state: queued, the id of the lease holding it (>= 0), or settled (admission.h)
+const int32_t kFileQueued = -1;
+
+inline const char* settledName(int32_t state) {
+    return state == kItemDone ? "done" : state == kItemSkipped ? "skipped" : "failed";
+}
+
+inline int32_t parseSettled(const std::string& name) {
+    return name == "done" ? kItemDone : name == "skipped" ? kItemSkipped : kItemFailed;
+}
+
+// ==========================================
+//                  COORDINATOR
+// ==========================================
+struct LeaseWorkerStats {
+    std::string host;
+    int threads = 0;
+    bool connected = true;
+    int images = 0, failed = 0, skipped = 0, duplicates = 0;
+    int leases = 0, expired = 0;
+    double settleSeconds = 0;          // sum of claim-to-settle times of its files
+};
+
+class LeaseCoordinator {
+public:
+    LeaseCoordinator(std::vector<ImageInfo> images, int leaseSize, int leaseSeconds)
+        : images_(images), state_(images.size(), kFileQueued), leaseSize_(std::max(1, leaseSize)),
+          leaseTime_(std::chrono::seconds(std::max(1, leaseSeconds))) {
+        for (size_t i = 0; i < images.size(); ++i) queue_.push_back((int)i);
+        unsettled_ = (int)images.size();
+    }
+
+    ~LeaseCoordinator() { if (listenFd_ >= 0) ::close(listenFd_); }
+
+    // 'port' 0 picks a free port; port() has the one in use afterwards.
+    bool listen(int port, std::string& error) {
+        port_ = port;
+        listenFd_ = listenOn(port_, error);
+        return listenFd_ >= 0;
+    }
+    int port() const { return port_; }
+    int listenFd() const { return listenFd_; }
+
+    // Serves workers until every file is settled and every worker has disconnected,
+    // or until tick() (called about every kCoordinatorTickMillis) returns false.
+    void run(const std::function<bool()>& tick) {
+        while (unsettled_ > 0 || connectedWorkers() > 0) {
+            expireLeases();
+            if (!tick()) break;
+
+            std::vector<pollfd> fds = {{listenFd_, POLLIN, 0}};
+            std::vector<int> ids = {-1};
+            for (auto& c : clients_) {
+                fds.push_back({c.second->fd(), POLLIN, 0});
+                ids.push_back(c.first);
+            }
+            if (poll(fds.data(), fds.size(), kCoordinatorTickMillis) <= 0) continue;
+
+            if (fds[0].revents & POLLIN) accept();
+            for (size_t i = 1; i < fds.size(); ++i) {
+                if (!fds[i].revents) continue;
+                int id = ids[i];
+                LineSocket& socket = *clients_[id];
+                bool open = socket.fill();
+                std::string line;
+                while (open && socket.nextLine(line)) open = handle(id, line);
+                if (!open) disconnect(id);
+            }
+        }
+    }
+
+    int unsettled() const { return unsettled_; }
+    int connectedWorkers() const { return (int)clients_.size(); }
+    int leasesGranted() const { return nextLease_; }
+    const std::vector<LeaseWorkerStats>& workers() const { return workers_; }
+    int settled(int32_t state) const { return (int)std::count(state_.begin(), state_.end(), state); }
+
+private:
+    struct Lease {
+        int worker;
+        std::vector<int> files;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    void accept() {
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0) return;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        int id = (int)workers_.size();
+        workers_.push_back(LeaseWorkerStats());
+        clients_[id].reset(new LineSocket(fd));
+    }
+
+    // Handles one request line; false drops the connection.
+    bool handle(int worker, const std::string& line) {
+        std::istringstream in(line);
+        std::string verb;
+        in >> verb;
+        LineSocket& socket = *clients_[worker];
+        LeaseWorkerStats& stats = workers_[worker];
+
+        if (verb == "HELLO") {
+            in >> stats.host >> stats.threads;
+            std::cout << "[coordinator] worker w" << worker << " joined from " << stats.host << " (" << stats.threads << " threads)" << std::endl;
+            long long millis = std::chrono::duration_cast<std::chrono::milliseconds>(leaseTime_).count();
+            return socket.sendLine("WELCOME " + std::to_string(worker) + " " + std::to_string(millis));
+        }
+        if (verb == "LEASE") return grant(worker);
+        if (verb == "RENEW") {
+            int id = -1;
+            in >> id;
+            auto it = leases_.find(id);
+            if (it == leases_.end() || it->second.worker != worker) return socket.sendLine("LOST");
+            it->second.expires = std::chrono::steady_clock::now() + leaseTime_;
+            return socket.sendLine("OK");
+        }
+        if (verb == "METRIC") {
+            int lease = -1, file = -1;
+            std::string state;
+            long long micros = 0;
+            in >> lease >> file >> state >> micros;
+            if (file >= 0 && file < (int)images_.size()) settle(worker, lease, file, parseSettled(state), micros);
+            return true;
+        }
+        return false;
+    }
+
+    bool grant(int worker) {
+        LineSocket& socket = *clients_[worker];
+        std::vector<int> files;
+        while (!queue_.empty() && (int)files.size() < leaseSize_) {
+            int file = queue_.front();
+            queue_.pop_front();
+            if (state_[file] == kFileQueued) files.push_back(file);   // not settled by a late result meanwhile
+        }
+        if (files.empty()) return socket.sendLine(unsettled_ > 0 ? "WAIT " + std::to_string(kLeaseWaitMillis) : "DONE");
+
+        int id = nextLease_++;
+        leases_[id] = {worker, files, std::chrono::steady_clock::now() + leaseTime_};
+        workers_[worker].leases++;
+        std::ostringstream out;
+        out << "GRANT " << id << " " << files.size();
+        for (int file : files) {
+            state_[file] = id;
+            const ImageInfo& info = images_[file];
+            out << "\n" << file << " " << info.readable << " " << info.width << " " << info.height << " " << info.channels << " " << info.path;
+        }
+        return socket.sendLine(out.str());
+    }
+
+    void settle(int worker, int lease, int file, int32_t state, long long micros) {
+        LeaseWorkerStats& stats = workers_[worker];
+        if (state_[file] < kFileQueued) {
+            stats.duplicates++;
+            return;
+        }
+        state_[file] = state;
+        unsettled_--;
+        if (state == kItemDone) stats.images++;
+        else if (state == kItemSkipped) stats.skipped++;
+        else stats.failed++;
+        stats.settleSeconds += micros / 1e6;
+
+        // A lease closes once all of its files are settled
+        auto it = leases_.find(lease);
+        if (it == leases_.end()) return;
+        for (int f : it->second.files) if (state_[f] >= kFileQueued) return;
+        leases_.erase(it);
+    }
+
+    // Puts the lease's unsettled files back at the front of the queue, in order.
+    void expire(std::map<int, Lease>::iterator it) {
+        const std::vector<int>& files = it->second.files;
+        int requeued = 0;
+        for (auto f = files.rbegin(); f != files.rend(); ++f) {
+            if (state_[*f] != it->first) continue;
+            state_[*f] = kFileQueued;
+            queue_.push_front(*f);
+            requeued++;
+        }
+        workers_[it->second.worker].expired++;
+        std::cout << "[coordinator] lease " << it->first << " of w" << it->second.worker << " expired, "
+                  << requeued << " file(s) requeued" << std::endl;
+        leases_.erase(it);
+    }
+
+    void expireLeases() {
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = leases_.begin(); it != leases_.end();) {
+            auto current = it++;
+            if (current->second.expires <= now) expire(current);
+        }
+    }
+
+    // A worker that disconnects loses its leases at once.
+    void disconnect(int worker) {
+        clients_.erase(worker);
+        workers_[worker].connected = false;
+        std::cout << "[coordinator] worker w" << worker << " disconnected" << std::endl;
+        for (auto it = leases_.begin(); it != leases_.end();) {
+            auto current = it++;
+            if (current->second.worker == worker) expire(current);
+        }
+    }
+
+    std::vector<ImageInfo> images_;
+    std::vector<int32_t> state_;
+    std::deque<int> queue_;
+    std::map<int, Lease> leases_;
+    std::map<int, std::unique_ptr<LineSocket>> clients_;   // by worker id
+    std::vector<LeaseWorkerStats> workers_;
+    int unsettled_ = 0;
+    int nextLease_ = 0;
+    int leaseSize_;
+    std::chrono::steady_clock::duration leaseTime_;
+    int listenFd_ = -1;
+    int port_ = 0;
+};
+
+// ==========================================
+//                    WORKER
+// ==========================================
+class LeaseSource : public WorkSource {
+public:
+    // 'slot' places the worker's threads among other workers on this host (CPU placement).
+    explicit LeaseSource(int slot) : slot_(slot) {}
+
+    ~LeaseSource() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        if (heartbeat_.joinable()) heartbeat_.join();
+    }
+
+    // Says HELLO and starts renewing leases every third of the coordinator's lease time.
+    bool connect(const std::string& host, int port, int threads, std::string& error) {
+        if (!socket_.connectTo(host, port, error)) return false;
+        char name[256] = "localhost";
+        gethostname(name, sizeof(name) - 1);
+        std::string reply;
+        if (!socket_.sendLine("HELLO " + std::string(name) + " " + std::to_string(threads)) || !socket_.readLine(reply)
+            || reply.compare(0, 8, "WELCOME ") != 0) {
+            error = "Coordinator did not answer HELLO";
+            return false;
+        }
+        std::istringstream welcome(reply.substr(8));
+        long long leaseMillis = 0;
+        welcome >> id_ >> leaseMillis;
+        auto every = std::chrono::milliseconds(std::max(1LL, leaseMillis / 3));
+        heartbeat_ = std::thread([this, every] { renewLoop(every); });
+        return true;
+    }
+
+    int index() const override { return slot_; }
+    std::string tag() const override { return "[w" + std::to_string(id_) + "] "; }
+
+    bool claim(ImageInfo& info) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (files_.empty()) {
+            if (done_) return false;
+            std::string reply;
+            if (!socket_.sendLine("LEASE") || !socket_.readLine(reply)) {
+                done_ = true;   // the coordinator has gone
+                continue;
+            }
+            std::istringstream in(reply);
+            std::string verb;
+            in >> verb;
+            if (verb == "GRANT") {
+                int lease = 0, n = 0;
+                in >> lease >> n;
+                for (int i = 0; i < n; ++i) {
+                    std::string line;
+                    if (!socket_.readLine(line)) { done_ = true; break; }
+                    files_.push_back({lease, parseFile(line)});
+                }
+                open_[lease] = n;
+            } else if (verb == "WAIT") {
+                // The coordinator may be waiting for images this worker holds: let the batch loop run them first
+                if (!claimed_.empty()) return false;
+                int millis = kLeaseWaitMillis;
+                in >> millis;
+                wake_.wait_for(lock, std::chrono::milliseconds(millis), [&] { return stop_; });
+            } else {
+                done_ = true;
+            }
+        }
+        auto next = files_.front();
+        files_.pop_front();
+        info = next.second;
+        claimed_[info.id] = {next.first, std::chrono::steady_clock::now()};
+        return true;
+    }
+
+    void finish(const ImageInfo& info, int32_t state) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = claimed_.find(info.id);
+        if (it == claimed_.end()) return;
+        int lease = it->second.first;
+        long long micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - it->second.second).count();
+        claimed_.erase(it);
+        socket_.sendLine("METRIC " + std::to_string(lease) + " " + std::to_string(info.id) + " " + settledName(state) + " " + std::to_string(micros));
+        if (state == kItemDone) images_++;
+        auto open = open_.find(lease);
+        if (open != open_.end() && --open->second <= 0) open_.erase(open);
+    }
+
+    void recordBusy(double) override {}
+
+    int images() const { return images_; }
+    int lostLeases() const { return lost_; }
+
+private:
+    static ImageInfo parseFile(const std::string& line) {
+        std::istringstream fields(line);
+        ImageInfo info;
+        fields >> info.id >> info.readable >> info.width >> info.height >> info.channels;
+        fields.get();   // the separator; the path may contain spaces
+        std::getline(fields, info.path);
+        info.filename = std::filesystem::path(info.path).filename().string();
+        info.bytes = info.readable ? (size_t)info.width * info.height * info.channels : 0;
+        return info;
+    }
+
+    // Renews every open lease; a LOST lease's files that have not been started are dropped.
+    void renewLoop(std::chrono::milliseconds every) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!wake_.wait_for(lock, every, [&] { return stop_; })) {
+            std::vector<int> leases;
+            for (const auto& l : open_) leases.push_back(l.first);
+            for (int lease : leases) {
+                std::string reply;
+                if (!socket_.sendLine("RENEW " + std::to_string(lease)) || !socket_.readLine(reply)) return;
+                if (reply != "LOST") continue;
+                lost_++;
+                open_.erase(lease);
+                files_.erase(std::remove_if(files_.begin(), files_.end(), [&](const std::pair<int, ImageInfo>& f) { return f.first == lease; }), files_.end());
+                std::cout << tag() << "lease " << lease << " lost, unstarted files dropped" << std::endl;
+            }
+        }
+    }
+
+    LineSocket socket_;
+    int slot_;
+    int id_ = -1;
+    std::mutex mutex_;                             // one request/reply exchange at a time
+    std::condition_variable wake_;
+    std::deque<std::pair<int, ImageInfo>> files_;  // (lease, file) not yet claimed
+    std::map<int, int> open_;                      // lease -> files not yet settled
+    std::map<int, std::pair<int, std::chrono::steady_clock::time_point>> claimed_;   // file -> (lease, claimed at)
+    bool done_ = false, stop_ = false;
+    int images_ = 0, lost_ = 0;
+    std::thread heartbeat_;
+};
+
+#endif // CST435_LEASING_H
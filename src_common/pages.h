@@ -0,0 +1,147 @@
+/**
+ * @file pages.h
+ * @brief Frame allocation on small or huge pages, parallel pre-faulting and fault counts
+ * @course CST435: Parallel Computing
+ *
+ * A 64 MB frame on 4 KB pages needs 16384 TLB entries, so a stencil pass
+ * over a large image keeps missing the dTLB; and its pages are only faulted
+ * in when first written, inside the timed batch. --pages selects:
+ *   small   : 4 KB pages (default)
+ *   thp     : 2 MB aligned and madvise(MADV_HUGEPAGE), so the kernel backs it
+ *             with transparent huge pages when it has them
+ *   hugetlb : mmap(MAP_HUGETLB) from the reserved hugetlbfs pool
+ *             (vm.nr_hugepages); falls back to thp when the pool is empty
+ * Frames are pre-faulted by the workers before the timer starts (one huge
+ * page per task, so each 2 MB page is zeroed by one thread), and the batch
+ * reports the page faults it still took.
+ */
+
+#ifndef CST435_PAGES_H
+#define CST435_PAGES_H
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "executor.h"
+#include "pipeline.h"
+
+const size_t kHugePageBytes = 2 * 1024 * 1024;
+
+enum class PageMode { Small, Transparent, HugeTlb };
+
+inline bool parsePageMode(const std::string& name, PageMode& mode) {
+    if (name == "small") mode = PageMode::Small;
+    else if (name == "thp") mode = PageMode::Transparent;
+    else if (name == "hugetlb") mode = PageMode::HugeTlb;
+    else return false;
+    return true;
+}
+
+inline const char* pageModeName(PageMode mode) {
+    switch (mode) {
+        case PageMode::Transparent: return "thp";
+        case PageMode::HugeTlb: return "hugetlb";
+        default: return "small";
+    }
+}
+
+// Frames that came from mmap(MAP_HUGETLB) and their lengths; everything else is free()d.
+struct HugeTlbFrames {
+    std::mutex mutex;
+    std::map<void*, size_t> lengths;
+};
+
+inline HugeTlbFrames& hugeTlbFrames() {
+    static HugeTlbFrames frames;
+    return frames;
+}
+
+// Page-aligned frame buffer (release with releaseFrame()); alignedRowGrain() assumes frames start on a page.
+inline unsigned char* allocateFrame(size_t bytes, PageMode pages = PageMode::Small) {
+    if (pages == PageMode::HugeTlb) {
+        size_t length = (bytes + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes;
+        void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            HugeTlbFrames& frames = hugeTlbFrames();
+            std::lock_guard<std::mutex> lock(frames.mutex);
+            frames.lengths[p] = length;
+            return (unsigned char*)p;
+        }
+        pages = PageMode::Transparent;
+    }
+    if (pages == PageMode::Transparent) {
+        size_t length = (bytes + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes;
+        void* p = std::aligned_alloc(kHugePageBytes, length);
+        if (p) madvise(p, length, MADV_HUGEPAGE);
+        return (unsigned char*)p;
+    }
+    return (unsigned char*)std::aligned_alloc(kPageBytes, (bytes + kPageBytes - 1) / kPageBytes * kPageBytes);
+}
+
+inline void releaseFrame(unsigned char* frame) {
+    if (!frame) return;
+    HugeTlbFrames& frames = hugeTlbFrames();
+    {
+        std::lock_guard<std::mutex> lock(frames.mutex);
+        auto it = frames.lengths.find(frame);
+        if (it != frames.lengths.end()) {
+            munmap(it->first, it->second);
+            frames.lengths.erase(it);
+            return;
+        }
+    }
+    std::free(frame);
+}
+
+// Writes every page of the frame from the workers, one huge page per task.
+inline void prefaultFrame(Executor& exec, unsigned char* frame, size_t bytes) {
+    int pages = (int)((bytes + kPageBytes - 1) / kPageBytes);
+    exec.parallelFor(pages, [&](int s, int e) {
+        for (int p = s; p < e; ++p) frame[(size_t)p * kPageBytes] = 0;
+    }, (int)(kHugePageBytes / kPageBytes));
+}
+
+struct PageFaults {
+    long minor = 0, major = 0;
+};
+
+// Faults taken by the whole process so far (all threads).
+inline PageFaults pageFaults() {
+    PageFaults f;
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        f.minor = usage.ru_minflt;
+        f.major = usage.ru_majflt;
+    }
+    return f;
+}
+
+// Largest resident set this process has had, in kB.
+inline long peakRssKilobytes() {
+    rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+// Anonymous memory of this process currently backed by huge pages (THP and hugetlb), in kB.
+inline long hugePageKilobytes() {
+    std::ifstream file("/proc/self/smaps_rollup");
+    std::string line;
+    long total = 0;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        long kb = 0;
+        if (!(fields >> key >> kb)) continue;   // the "[rollup]" header line
+        if (key == "AnonHugePages:" || key == "Private_Hugetlb:" || key == "Shared_Hugetlb:") total += kb;
+    }
+    return total;
+}
+
+#endif // CST435_PAGES_H
@@ -0,0 +1,136 @@
+/**
+ * @file perf_counters.h
+ * @brief Per-worker hardware write-miss counters (--counters)
+ * @course CST435: Parallel Computing
+ *
+ * CountingExecutor wraps any backend. The first time a worker thread runs a
+ * sub-range it opens a perf_event counter for itself; the counter is only
+ * enabled while the body runs, so decoding and idle waiting are not counted.
+ * The event is the first one the host supports of:
+ *   L1D write misses, LLC write misses, all cache misses
+ * Workers whose row ranges meet inside a cache line keep stealing that line
+ * from each other, which shows up as extra write misses; compare
+ * --partition=rows with the default cache-line aligned partition.
+ */
+
+#ifndef CST435_PERF_COUNTERS_H
+#define CST435_PERF_COUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+
+struct CounterEvent {
+    uint32_t type;
+    uint64_t config;
+    const char* name;
+};
+
+inline const std::vector<CounterEvent>& writeMissEvents() {
+    static const std::vector<CounterEvent> events = {
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_WRITE << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "L1D write misses"},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_WRITE << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "LLC write misses"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache misses"},
+    };
+    return events;
+}
+
+// Opens a disabled user-space counter for the calling thread. Returns -1 on failure.
+inline int openThreadCounter(const CounterEvent& event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+class CountingExecutor : public Executor {
+public:
+    explicit CountingExecutor(std::unique_ptr<Executor> inner) : inner_(std::move(inner)) {
+        for (const CounterEvent& e : writeMissEvents()) {
+            int fd = openThreadCounter(e);
+            if (fd >= 0) { close(fd); event_ = &e; break; }
+            error_ = std::strerror(errno);
+        }
+    }
+
+    ~CountingExecutor() override {
+        for (auto& w : workers_) if (w->fd >= 0) close(w->fd);
+    }
+
+    const char* name() const override { return inner_->name(); }
+    int threads() const override { return inner_->threads(); }
+
+    void parallelFor(int n, const std::function<void(int, int)>& body, int grain) override {
+        inner_->parallelFor(n, [&](int begin, int end) {
+            Worker& w = local();
+            if (w.fd >= 0) ioctl(w.fd, PERF_EVENT_IOC_ENABLE, 0);
+            body(begin, end);
+            if (w.fd >= 0) ioctl(w.fd, PERF_EVENT_IOC_DISABLE, 0);
+            w.ranges++;
+            w.rows += end - begin;
+        }, grain);
+    }
+
+    void forEachWorker(const std::function<void(int)>& fn) override { inner_->forEachWorker(fn); }
+
+    void report() const {
+        std::cout << "   Per-worker counters (" << (event_ ? event_->name : "hardware counters unavailable: " + error_) << "):" << std::endl;
+        std::cout << "   " << std::left << std::setw(10) << "tid" << std::right << std::setw(10) << "ranges"
+                  << std::setw(12) << "rows" << std::setw(16) << "write misses" << std::endl;
+        for (const auto& w : workers_) {
+            uint64_t misses = 0;
+            bool counted = w->fd >= 0 && read(w->fd, &misses, sizeof(misses)) == (ssize_t)sizeof(misses);
+            std::cout << "   " << std::left << std::setw(10) << w->tid << std::right << std::setw(10) << w->ranges
+                      << std::setw(12) << w->rows << std::setw(16) << (counted ? std::to_string(misses) : std::string("n/a")) << std::endl;
+        }
+    }
+
+private:
+    struct Worker {
+        long tid = 0;
+        int fd = -1;
+        uint64_t ranges = 0, rows = 0;
+    };
+
+    // The calling thread's entry, created (and its counter opened) on first use.
+    Worker& local() {
+        thread_local const CountingExecutor* owner = nullptr;
+        thread_local Worker* mine = nullptr;
+        if (owner != this) {
+            auto w = std::make_unique<Worker>();
+            w->tid = (long)syscall(SYS_gettid);
+            if (event_) w->fd = openThreadCounter(*event_);
+            std::lock_guard<std::mutex> lock(mutex_);
+            mine = w.get();
+            owner = this;
+            workers_.push_back(std::move(w));
+        }
+        return *mine;
+    }
+
+    std::unique_ptr<Executor> inner_;
+    const CounterEvent* event_ = nullptr;
+    std::string error_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+#endif // CST435_PERF_COUNTERS_H
@@ -0,0 +1,613 @@
+/**
+ * @file pipeline.h
+ * @brief Pipeline specification, plan compiler and plan executor
+ * @course CST435: Parallel Computing
+ *
+ * A pipeline spec lists the stages in order, separated by commas (CLI) or
+ * one per line (config file, '#' starts a comment). Parameters follow a ':'.
+ *
+ *   grayscale
+ *   blur[:gaussian|box]
+ *   edge
+ *   sharpen[:cross|full]
+ *   brightness[:VALUE]        VALUE in [-255, 255], default 50
+ *   convolve:K00 K01 ... K22  any 3x3 kernel, 9 coefficients in row order
+ *   contrast[:FACTOR]         (v - 128) * FACTOR + 128, FACTOR in [0, 10], default 1.5
+ *   gamma[:GAMMA]             255 * (v / 255) ^ (1 / GAMMA), GAMMA in (0, 10], default 2.2
+ *   threshold[:LEVEL]         255 if v >= LEVEL else 0, LEVEL in [0, 255], default 128
+ *
+ * compilePlan() validates the spec and turns it into steps:
+ *   - runs of per-byte tone stages (brightness, contrast, gamma, threshold) are composed
+ *     into one 256-entry lookup table, so any number of them costs a single table lookup
+ *   - consecutive point (per-pixel) stages are fused into one pass over each row range
+ *   - point stages run in place whenever their input is already an intermediate buffer
+ *   - stencil (3x3) stages ping-pong between the fewest buffers that keep them race free,
+ *     or (inPlaceStencils) overwrite their input through a rolling line buffer
+ * executePlan() streams point-step output past the cache once frames outgrow the
+ * last-level cache (see filters.h).
+ */
+
+#ifndef CST435_PIPELINE_H
+#define CST435_PIPELINE_H
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "filters.h"
+
+// Project specification order: Grayscale -> Blur -> Edge (Sobel) -> Sharpen -> Brightness
+const char* const kDefaultPipeline = "grayscale,blur,edge,sharpen,brightness:50";
+
+// ==========================================
+//            PIPELINE SPECIFICATION
+// ==========================================
+enum class StageKind { Grayscale, Blur, Edge, Sharpen, Brightness, Convolve, Contrast, Gamma, Threshold, Lut };
+
+// Row kernel compiled at run time for one stage and channel count (see jit.h)
+typedef void (*JitKernelFn)(const unsigned char* input, unsigned char* output, int width, int height, int startRow, int endRow);
+
+struct StageSpec {
+    StageKind kind;
+    int value = 0;                    // brightness offset / threshold level
+    float amount = 0.0f;              // contrast factor / gamma
+    float kernel[3][3] = {};          // convolution kernel for blur / sharpen / convolve
+    std::array<unsigned char, 256> lut{}; // composed table for StageKind::Lut
+    std::string label;                // canonical "name[:param]" used when printing
+    JitKernelFn jit[5] = {};          // specialised kernel per channel count, if compiled
+    Border border;                    // how a stencil reads samples outside the image
+};
+
+// Byte stages map every (non-alpha) sample through a function of that sample alone.
+inline bool isByteStage(StageKind kind) {
+    return kind == StageKind::Brightness || kind == StageKind::Contrast || kind == StageKind::Gamma ||
+           kind == StageKind::Threshold || kind == StageKind::Lut;
+}
+
+// Point stages read and write the same pixel only, so they can be fused and run in place.
+inline bool isPointStage(StageKind kind) {
+    return kind == StageKind::Grayscale || isByteStage(kind);
+}
+
+// Per-sample definition of a byte stage (used to build lookup tables).
+inline unsigned char bytePixel(const StageSpec& stage, unsigned char v) {
+    switch (stage.kind) {
+        case StageKind::Brightness: return brightnessPixel(v, stage.value);
+        case StageKind::Contrast:   return contrastPixel(v, stage.amount);
+        case StageKind::Gamma:      return gammaPixel(v, stage.amount);
+        case StageKind::Threshold:  return thresholdPixel(v, stage.value);
+        case StageKind::Lut:        return stage.lut[v];
+        default:                    return v;
+    }
+}
+
+inline std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+// First line of a (small) file such as /proc or /sys entries, trimmed; "" if unreadable.
+inline std::string readFirstLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return trim(line);
+}
+
+// Parses "clamp", "mirror", "wrap" or "constant[:VALUE]" (VALUE in [0, 255], default 0).
+inline bool parseBorder(const std::string& text, Border& border, std::string& error) {
+    std::string name = trim(text.substr(0, text.find(':')));
+    std::string param = text.find(':') == std::string::npos ? "" : trim(text.substr(text.find(':') + 1));
+    border = Border();
+    if (name == "constant") {
+        border.mode = BorderMode::Constant;
+        int v = param.empty() ? 0 : std::atoi(param.c_str());
+        if (v < 0 || v > 255) { error = "constant border value must be in [0, 255]"; return false; }
+        border.value = (unsigned char)v;
+        return true;
+    }
+    if (!param.empty()) { error = "border '" + name + "' takes no parameter"; return false; }
+    if (name == "clamp") border.mode = BorderMode::Clamp;
+    else if (name == "mirror") border.mode = BorderMode::Mirror;
+    else if (name == "wrap") border.mode = BorderMode::Wrap;
+    else { error = "unknown border '" + text + "' (clamp|mirror|wrap|constant[:VALUE])"; return false; }
+    return true;
+}
+
+inline std::string borderName(const Border& border) {
+    switch (border.mode) {
+        case BorderMode::Clamp:    return "clamp";
+        case BorderMode::Mirror:   return "mirror";
+        case BorderMode::Wrap:     return "wrap";
+        case BorderMode::Constant: return "constant:" + std::to_string(border.value);
+    }
+    return "";
+}
+
+// Parses one "name[:param]" token. Returns false and fills 'error' if it is invalid.
+inline bool parseStage(const std::string& token, StageSpec& stage, std::string& error) {
+    std::string name = token, param;
+    size_t colon = token.find(':');
+    if (colon != std::string::npos) {
+        name = trim(token.substr(0, colon));
+        param = trim(token.substr(colon + 1));
+    }
+
+    if (name == "grayscale" || name == "edge") {
+        if (!param.empty()) { error = "stage '" + name + "' takes no parameter"; return false; }
+        stage.kind = (name == "grayscale") ? StageKind::Grayscale : StageKind::Edge;
+        stage.label = name;
+    } else if (name == "blur") {
+        if (param.empty() || param == "gaussian") std::memcpy(stage.kernel, kGaussianKernel, sizeof(stage.kernel));
+        else if (param == "box") std::memcpy(stage.kernel, kBoxKernel, sizeof(stage.kernel));
+        else { error = "unknown blur kernel '" + param + "' (gaussian|box)"; return false; }
+        stage.kind = StageKind::Blur;
+        stage.label = "blur:" + (param.empty() ? std::string("gaussian") : param);
+    } else if (name == "sharpen") {
+        if (param.empty() || param == "cross") std::memcpy(stage.kernel, kSharpenCrossKernel, sizeof(stage.kernel));
+        else if (param == "full") std::memcpy(stage.kernel, kSharpenFullKernel, sizeof(stage.kernel));
+        else { error = "unknown sharpen kernel '" + param + "' (cross|full)"; return false; }
+        stage.kind = StageKind::Sharpen;
+        stage.label = "sharpen:" + (param.empty() ? std::string("cross") : param);
+    } else if (name == "brightness") {
+        stage.value = 50;
+        if (!param.empty()) {
+            char* endPtr = nullptr;
+            long v = std::strtol(param.c_str(), &endPtr, 10);
+            if (*endPtr != '\0' || v < -255 || v > 255) {
+                error = "brightness value '" + param + "' must be an integer in [-255, 255]";
+                return false;
+            }
+            stage.value = (int)v;
+        }
+        stage.kind = StageKind::Brightness;
+        stage.label = "brightness:" + std::to_string(stage.value);
+    } else if (name == "contrast" || name == "gamma") {
+        bool isGamma = (name == "gamma");
+        stage.amount = isGamma ? 2.2f : 1.5f;
+        if (!param.empty()) {
+            char* endPtr = nullptr;
+            float v = std::strtof(param.c_str(), &endPtr);
+            if (*endPtr != '\0' || v < 0.0f || v > 10.0f || (isGamma && v == 0.0f)) {
+                error = name + " value '" + param + "' must be a number in " + (isGamma ? "(0, 10]" : "[0, 10]");
+                return false;
+            }
+            stage.amount = v;
+        }
+        stage.kind = isGamma ? StageKind::Gamma : StageKind::Contrast;
+        std::ostringstream label;
+        label << name << ":" << stage.amount;
+        stage.label = label.str();
+    } else if (name == "threshold") {
+        stage.value = 128;
+        if (!param.empty()) {
+            char* endPtr = nullptr;
+            long v = std::strtol(param.c_str(), &endPtr, 10);
+            if (*endPtr != '\0' || v < 0 || v > 255) {
+                error = "threshold level '" + param + "' must be an integer in [0, 255]";
+                return false;
+            }
+            stage.value = (int)v;
+        }
+        stage.kind = StageKind::Threshold;
+        stage.label = "threshold:" + std::to_string(stage.value);
+    } else if (name == "convolve") {
+        std::istringstream coeffs(param);
+        std::string word;
+        int n = 0;
+        while (coeffs >> word) {
+            char* endPtr = nullptr;
+            float v = std::strtof(word.c_str(), &endPtr);
+            if (*endPtr != '\0' || n >= 9) { n = -1; break; }
+            stage.kernel[n / 3][n % 3] = v;
+            ++n;
+        }
+        if (n != 9) { error = "convolve needs exactly 9 numeric coefficients, e.g. convolve:0 -1 0 -1 5 -1 0 -1 0"; return false; }
+        stage.kind = StageKind::Convolve;
+        stage.label = "convolve:" + param;
+    } else {
+        error = "unknown stage '" + name + "' (grayscale|blur|edge|sharpen|brightness|convolve|contrast|gamma|threshold)";
+        return false;
+    }
+    return true;
+}
+
+// Parses a comma and/or newline separated spec; '#' comments run to end of line.
+inline bool parsePipelineSpec(const std::string& text, std::vector<StageSpec>& stages, std::string& error) {
+    stages.clear();
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream tokens(line);
+        std::string token;
+        while (std::getline(tokens, token, ',')) {
+            token = trim(token);
+            if (token.empty()) continue;
+            StageSpec stage;
+            if (!parseStage(token, stage, error)) return false;
+            stages.push_back(stage);
+        }
+    }
+    if (stages.empty()) { error = "pipeline has no stages"; return false; }
+    return true;
+}
+
+inline bool loadPipelineFile(const std::string& path, std::string& text, std::string& error) {
+    std::ifstream file(path);
+    if (!file) { error = "cannot open pipeline file '" + path + "'"; return false; }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    text = ss.str();
+    return true;
+}
+
+// ==========================================
+//           LOOKUP TABLE COMPOSITION
+// ==========================================
+// Replaces every run of consecutive byte stages with one StageKind::Lut stage whose
+// table is the composition of the run (evaluated for all 256 inputs). A lone
+// brightness stage is kept: its saturating add is cheaper than a table lookup.
+inline std::vector<StageSpec> composeLookupTables(const std::vector<StageSpec>& stages) {
+    std::vector<StageSpec> out;
+    for (size_t i = 0; i < stages.size();) {
+        if (!isByteStage(stages[i].kind)) { out.push_back(stages[i++]); continue; }
+
+        size_t end = i;
+        while (end < stages.size() && isByteStage(stages[end].kind)) ++end;
+        if (end - i == 1 && stages[i].kind == StageKind::Brightness) { out.push_back(stages[i++]); continue; }
+
+        StageSpec lut;
+        lut.kind = StageKind::Lut;
+        lut.label = "lut[";
+        for (int v = 0; v < 256; ++v) {
+            unsigned char x = (unsigned char)v;
+            for (size_t k = i; k < end; ++k) x = bytePixel(stages[k], x);
+            lut.lut[v] = x;
+        }
+        for (size_t k = i; k < end; ++k) lut.label += (k > i ? " + " : "") + stages[k].label;
+        lut.label += "]";
+        out.push_back(lut);
+        i = end;
+    }
+    return out;
+}
+
+// ==========================================
+//               PLAN COMPILER
+// ==========================================
+// Buffer index kSourceImage is the decoded image: it is read-only.
+const int kSourceImage = -1;
+
+struct PlanStep {
+    std::vector<StageSpec> stages;   // more than one = fused point stages
+    int src;                         // buffer read (kSourceImage or 0..numBuffers-1)
+    int dst;                         // buffer written
+    bool stencil;                    // 3x3 neighbourhood stage
+};
+
+struct Plan {
+    std::vector<PlanStep> steps;
+    int numBuffers = 0;              // intermediate frame buffers needed
+    int resultBuffer = kSourceImage; // where the final image ends up
+};
+
+// 'inPlaceStencils' lets stencil stages overwrite an intermediate input too (see
+// runStencilInPlace()), so any chain needs a single frame buffer.
+inline Plan compilePlan(const std::vector<StageSpec>& stages, bool inPlaceStencils = false) {
+    Plan plan;
+    int current = kSourceImage;
+
+    for (size_t i = 0; i < stages.size(); ++i) {
+        PlanStep step;
+        step.stencil = !isPointStage(stages[i].kind);
+        step.src = current;
+
+        if (step.stencil) {
+            // Needs a separate output: take the lowest buffer that is not our input
+            // (or overwrite the input, unless it is the decoded image)
+            step.stages.push_back(stages[i]);
+            step.dst = (inPlaceStencils && current != kSourceImage) ? current : (current == 0) ? 1 : 0;
+        } else {
+            // Fuse the whole run of point stages into one pass
+            while (i < stages.size() && isPointStage(stages[i].kind)) step.stages.push_back(stages[i++]);
+            --i;
+            // In place unless we would overwrite the decoded image
+            step.dst = (current == kSourceImage) ? 0 : current;
+        }
+
+        plan.numBuffers = std::max(plan.numBuffers, step.dst + 1);
+        current = step.dst;
+        plan.steps.push_back(step);
+    }
+    plan.resultBuffer = current;
+    return plan;
+}
+
+// Estimated main-memory traffic of one step: every step streams its input frame
+// once and writes its output frame once; fused point stages reuse rows while they
+// are still in cache, so they add no extra traffic.
+inline size_t stepBytesRead(const PlanStep&, size_t frameBytes) { return frameBytes; }
+inline size_t stepBytesWritten(const PlanStep&, size_t frameBytes) { return frameBytes; }
+
+inline std::string bufferName(int b) {
+    return (b == kSourceImage) ? "image" : "buf" + std::to_string(b);
+}
+
+inline void printPlan(const Plan& plan, int width, int height, int channels) {
+    size_t frameBytes = (size_t)width * height * channels;
+    size_t unfusedStages = 0, total = 0;
+
+    std::cout << "PIPELINE PLAN (" << width << "x" << height << "x" << channels
+              << ", " << plan.numBuffers << " intermediate buffer(s)):" << std::endl;
+    for (size_t i = 0; i < plan.steps.size(); ++i) {
+        const PlanStep& step = plan.steps[i];
+        std::string names;
+        for (size_t k = 0; k < step.stages.size(); ++k) names += (k ? " + " : "") + step.stages[k].label;
+        unfusedStages += step.stages.size();
+
+        size_t bytes = stepBytesRead(step, frameBytes) + stepBytesWritten(step, frameBytes);
+        total += bytes;
+        std::cout << "  " << (i + 1) << ". " << std::left << std::setw(34) << names << std::right
+                  << " " << bufferName(step.src) << " -> " << bufferName(step.dst)
+                  << (step.src == step.dst ? " (in place)" : "")
+                  << (step.stages.size() > 1 ? " (fused)" : "")
+                  << "  ~" << std::fixed << std::setprecision(2) << bytes / 1e6 << " MB" << std::endl;
+    }
+    std::cout << "  Estimated traffic: " << total / 1e6 << " MB per image ("
+              << unfusedStages * 2 * frameBytes / 1e6 << " MB without fusion)" << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
+
+// ==========================================
+//               PLAN EXECUTION
+// ==========================================
+// Rows handed out per work unit by dynamic backends.
+const int kRowGrain = 8;
+const size_t kCacheLineBytes = 64;
+const size_t kPageBytes = 4096;
+
+// Smallest grain >= kRowGrain whose multiples start on a cache line of a frame with
+// 'rowBytes' bytes per row (frame buffers are page aligned), or on a page when that
+// still leaves at least eight units per worker. Row ranges cut at multiples of it
+// never share a cache line, so workers cannot falsely share output lines.
+inline int alignedRowGrain(size_t rowBytes, int height, int workers) {
+    auto rowsPerBoundary = [&](size_t bytes) { return (int)(bytes / std::gcd(rowBytes, bytes)); };
+    int unit = rowsPerBoundary(kCacheLineBytes);
+    int page = rowsPerBoundary(kPageBytes);
+    if (page <= std::max(kRowGrain, height / (workers * 8))) unit = page;
+    return (kRowGrain + unit - 1) / unit * unit;
+}
+
+// Grain the plan executors use for a frame with 'rowBytes' bytes per row.
+inline int rowGrain(bool alignRows, size_t rowBytes, int height, int workers) {
+    return alignRows ? alignedRowGrain(rowBytes, height, workers) : kRowGrain;
+}
+
+// Size of the largest data/unified cache in /sys/devices/system/cpu/cpu0/cache
+// ("32K", "1024K", "32M"), or of the L3 reported by sysconf, or 8 MB if neither is known.
+inline size_t lastLevelCacheBytes() {
+    static const size_t bytes = [] {
+        size_t best = 0;
+        for (int index = 0; index < 16; ++index) {
+            std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+            std::string size = readFirstLine(dir + "size");
+            if (size.empty()) break;
+            if (readFirstLine(dir + "type") == "Instruction") continue;
+            size_t value = std::strtoull(size.c_str(), nullptr, 10);
+            char unit = size.back();
+            value <<= unit == 'K' ? 10 : unit == 'M' ? 20 : unit == 'G' ? 30 : 0;
+            best = std::max(best, value);
+        }
+#ifdef _SC_LEVEL3_CACHE_SIZE
+        if (best == 0) best = (size_t)std::max(0L, sysconf(_SC_LEVEL3_CACHE_SIZE));
+#endif
+        return best ? best : (size_t)8 << 20;
+    }();
+    return bytes;
+}
+
+// Point steps write their output with non-temporal stores once a frame is at least
+// this large (see filters.h); kNeverStream turns it off.
+const size_t kNeverStream = SIZE_MAX;
+
+inline size_t defaultStreamThreshold() { return lastLevelCacheBytes(); }
+
+// 'stream' = write the output rows with non-temporal stores (point kernels only).
+inline void runStageRows(const StageSpec& stage, const unsigned char* in, unsigned char* out, int width, int height, int channels, int s, int e, bool stream = false) {
+    switch (stage.kind) {
+        case StageKind::Grayscale:  applyGrayscale(in, out, width, height, channels, s, e, stream); break;
+        case StageKind::Blur:
+        case StageKind::Sharpen:
+        case StageKind::Convolve:
+            if (channels <= 4 && stage.jit[channels]) {
+                // The specialised kernel covers the interior; the border takes the peeled path
+                stage.jit[channels](in, out, width, height, s, e);
+                applyStencilBorder(in, out, width * channels, width, height, channels, s, e, stage.border,
+                                   [&](const unsigned char* p, int stride, int ch) { return convolvePixel(p, stride, ch, stage.kernel); });
+            } else {
+                applyConvolution(in, out, width, height, channels, stage.kernel, s, e, stage.border);
+            }
+            break;
+        case StageKind::Edge:       applyEdge(in, out, width, height, channels, s, e, stage.border); break;
+        case StageKind::Brightness: applyBrightness(in, out, width, height, channels, stage.value, s, e, stream); break;
+        case StageKind::Lut:        applyLookupTable(in, out, width, height, channels, stage.lut.data(), s, e, stream); break;
+        case StageKind::Contrast:
+        case StageKind::Gamma:
+        case StageKind::Threshold: {
+            // Normally composed into a Lut stage; evaluate directly if not
+            size_t begin = (size_t)s * width * channels, end = (size_t)e * width * channels;
+            for (size_t i = begin; i < end; ++i) {
+                out[i] = (channels == 4 && i % 4 == 3) ? in[i] : bytePixel(stage, in[i]);
+            }
+            break;
+        }
+    }
+}
+
+// ==========================================
+//           IN-PLACE STENCIL STEPS
+// ==========================================
+// A stencil step with src == dst overwrites its input. The frame is cut into
+// chunks of whole row grains; first the original first and last row of every
+// chunk are saved (the rows neighbouring chunks and the border rule may still
+// need), then every chunk runs top to bottom: the three input rows of output
+// row y sit in a ring of kStencilLines rows, the output goes to a line buffer
+// and only then over row y. The step needs two rows per chunk plus
+// kStencilLines + 2 rows per worker instead of a second frame.
+const int kStencilLines = 8;
+
+inline void runStencilInPlace(Executor& exec, const StageSpec& stage, unsigned char* frame, int width, int height, int channels, int grain) {
+    size_t rowBytes = (size_t)width * channels;
+    int parts = exec.threads() * 4;
+    int chunkRows = std::max(grain, (height + parts - 1) / parts);
+    chunkRows = (chunkRows + grain - 1) / grain * grain;
+    int chunks = (height + chunkRows - 1) / chunkRows;
+
+    std::vector<unsigned char> edges(2 * chunks * rowBytes);
+    exec.parallelFor(chunks, [&](int c0, int c1) {
+        for (int c = c0; c < c1; ++c) {
+            int first = c * chunkRows, last = std::min(height, first + chunkRows) - 1;
+            std::memcpy(&edges[2 * c * rowBytes], frame + first * rowBytes, rowBytes);
+            std::memcpy(&edges[(2 * c + 1) * rowBytes], frame + last * rowBytes, rowBytes);
+        }
+    }, 1);
+
+    exec.parallelFor(chunks, [&](int c0, int c1) {
+        std::vector<unsigned char> lines((kStencilLines + 2) * rowBytes);
+        unsigned char* ring = lines.data();
+        unsigned char* out = ring + kStencilLines * rowBytes;   // two rows: the kernels write row 1
+        for (int c = c0; c < c1; ++c) {
+            int begin = c * chunkRows, end = std::min(height, begin + chunkRows);
+            int top = 0;   // ring row holding input row y - 1
+
+            // Original row r while output row y is computed: rows y.. of this chunk are
+            // untouched, row y - 1 is in the ring, anything else is a saved chunk edge
+            auto original = [&](int r, int y) -> const unsigned char* {
+                if (r >= y && r < end) return frame + r * rowBytes;
+                if (r == y - 1 && r >= begin) return ring + top * rowBytes;
+                int owner = r / chunkRows;
+                return &edges[(2 * owner + (r == owner * chunkRows ? 0 : 1)) * rowBytes];
+            };
+            auto load = [&](int slot, int r, int y) {
+                int src = borderCoord(r, height, stage.border.mode);
+                if (src < 0) std::memset(ring + slot * rowBytes, stage.border.value, rowBytes);
+                else std::memcpy(ring + slot * rowBytes, original(src, y), rowBytes);
+            };
+
+            for (int k = 0; k < 3; ++k) load(k, begin - 1 + k, begin);
+            for (int y = begin; y < end; ++y) {
+                if (y > begin) {
+                    if (top + 3 == kStencilLines) {
+                        std::memmove(ring, ring + (top + 1) * rowBytes, 2 * rowBytes);
+                        top = 0;
+                    } else {
+                        ++top;
+                    }
+                    load(top + 2, y + 1, y);
+                }
+                // The ring rows are a 3-row image whose middle row is row y
+                runStageRows(stage, ring + top * rowBytes, out, width, 3, channels, 1, 2);
+                std::memcpy(frame + y * rowBytes, out + rowBytes, rowBytes);
+            }
+        }
+    }, 1);
+}
+
+// Rows [s, e) of one step. The first stage reads the step input; fused stages continue
+// in place on the same rows, so only the last one, whose rows are not read again here,
+// may stream.
+inline void runStepRows(const PlanStep& step, const unsigned char* in, unsigned char* out, int width, int height, int channels, int s, int e, bool stream) {
+    size_t last = step.stages.size() - 1;
+    runStageRows(step.stages[0], in, out, width, height, channels, s, e, stream && last == 0);
+    for (size_t k = 1; k <= last; ++k) {
+        runStageRows(step.stages[k], out, out, width, height, channels, s, e, stream && k == last);
+    }
+}
+
+// Runs every step of the plan; buffers[] must hold plan.numBuffers frames.
+// 'alignRows' cuts the rows at cache-line boundaries instead of every kRowGrain rows.
+// Point steps on frames of at least 'streamAbove' bytes stream their last stage's output.
+// Returns the buffer holding the final image.
+inline const unsigned char* executePlan(Executor& exec, const Plan& plan, const unsigned char* img, unsigned char* const* buffers, int width, int height, int channels, bool alignRows, size_t streamAbove = kNeverStream) {
+    auto resolve = [&](int b) { return b == kSourceImage ? img : buffers[b]; };
+    int grain = rowGrain(alignRows, (size_t)width * channels, height, exec.threads());
+    bool stream = (size_t)width * height * channels >= streamAbove;
+
+    for (const PlanStep& step : plan.steps) {
+        const unsigned char* in = resolve(step.src);
+        unsigned char* out = buffers[step.dst];
+        if (step.stencil && step.src == step.dst) {
+            runStencilInPlace(exec, step.stages[0], out, width, height, channels, grain);
+            continue;
+        }
+        exec.parallelFor(height, [&](int s, int e) {
+            runStepRows(step, in, out, width, height, channels, s, e, stream);
+        }, grain);
+    }
+    return resolve(plan.resultBuffer);
+}
+
+// ==========================================
+//               BATCHED EXECUTION
+// ==========================================
+// One image of a batch: its decoded pixels and its own intermediate frames.
+struct BatchImage {
+    const unsigned char* img = nullptr;
+    std::vector<unsigned char*> buffers;
+    int width = 0, height = 0, channels = 0;
+    const unsigned char* result = nullptr;   // set by executePlanBatch()
+};
+
+// Runs the plan over several images with one parallel region per step instead of one
+// per step and image. Every image is cut into blocks of its own row grain, and the
+// blocks of all images form a single index space, so no block straddles two images
+// and cache-line alignment within each frame is kept.
+inline void executePlanBatch(Executor& exec, const Plan& plan, std::vector<BatchImage>& batch, bool alignRows, size_t streamAbove = kNeverStream) {
+    size_t n = batch.size();
+    std::vector<int> grain(n), firstBlock(n + 1, 0);
+    std::vector<char> stream(n);
+    for (size_t i = 0; i < n; ++i) {
+        const BatchImage& im = batch[i];
+        grain[i] = rowGrain(alignRows, (size_t)im.width * im.channels, im.height, exec.threads());
+        firstBlock[i + 1] = firstBlock[i] + (im.height + grain[i] - 1) / grain[i];
+        stream[i] = (size_t)im.width * im.height * im.channels >= streamAbove;
+    }
+    auto resolve = [](const BatchImage& im, int b) { return b == kSourceImage ? im.img : im.buffers[b]; };
+
+    for (const PlanStep& step : plan.steps) {
+        if (step.stencil && step.src == step.dst) {
+            for (size_t i = 0; i < n; ++i) {
+                runStencilInPlace(exec, step.stages[0], batch[i].buffers[step.dst], batch[i].width, batch[i].height, batch[i].channels, grain[i]);
+            }
+            continue;
+        }
+        exec.parallelFor(firstBlock[n], [&](int b0, int b1) {
+            size_t i = std::upper_bound(firstBlock.begin(), firstBlock.end(), b0) - firstBlock.begin() - 1;
+            for (int b = b0; b < b1; ++i) {
+                int stop = std::min(b1, firstBlock[i + 1]);
+                const BatchImage& im = batch[i];
+                int s = (b - firstBlock[i]) * grain[i], e = std::min(im.height, (stop - firstBlock[i]) * grain[i]);
+                runStepRows(step, resolve(im, step.src), im.buffers[step.dst], im.width, im.height, im.channels, s, e, stream[i]);
+                b = stop;
+            }
+        }, 1);
+    }
+    for (BatchImage& im : batch) im.result = resolve(im, plan.resultBuffer);
+}
+
+#endif // CST435_PIPELINE_H
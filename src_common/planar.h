@@ -0,0 +1,299 @@
+/**
+ * @file planar.h
+ * @brief Planar (structure-of-arrays) pixel layout for the pipeline
+ * @course CST435: Parallel Computing
+ *
+ * The row kernels in filters.h walk interleaved pixels (RGBRGB...), so their
+ * innermost loop steps over channels with a stride of 'channels' bytes, which
+ * the compiler cannot vectorise well for 3-channel images. With
+ * --layout=planar the decoded image is split into one plane per channel:
+ *   - deinterleave once after decoding (SSSE3 byte shuffles, 16 pixels/step)
+ *   - every stage then runs on single-channel planes whose rows are padded to
+ *     a cache-line multiple, so stencils read unit-stride neighbours
+ *   - the result planes are interleaved again only for the encoder
+ * The per-pixel definitions are shared with the interleaved kernels (with
+ * channels = 1 and the padded plane stride), so results are identical.
+ */
+
+#ifndef CST435_PLANAR_H
+#define CST435_PLANAR_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "executor.h"
+#include "filters.h"
+#include "pipeline.h"
+
+// Plane rows start on a cache line boundary
+const int kPlaneAlign = 64;
+
+// Row stride of a plane: width rounded up to a cache line. Strides that are a
+// multiple of 4 KiB get one extra line so vertically adjacent samples do not
+// all map to the same cache set.
+inline int planeStride(int width) {
+    int stride = (width + kPlaneAlign - 1) / kPlaneAlign * kPlaneAlign;
+    if (stride % 4096 == 0) stride += kPlaneAlign;
+    return stride;
+}
+
+// One image in planar form: plane[c] holds channel c, row y starts at plane[c] + y * stride.
+struct PlanarFrame {
+    unsigned char* plane[4] = {nullptr, nullptr, nullptr, nullptr};
+};
+
+// Aligned storage for the source frame, the plan's intermediate frames and the
+// stride; grown on demand and reused across images.
+class PlanarWorkspace {
+public:
+    ~PlanarWorkspace() { std::free(storage_); }
+
+    // Frame 'numFrames - 1' is used for the deinterleaved source image.
+    // Returns false if the memory cannot be allocated.
+    bool prepare(int width, int height, int channels, int numFrames) {
+        stride_ = planeStride(width);
+        size_t planeBytes = ((size_t)stride_ * height + kPlaneAlign - 1) / kPlaneAlign * kPlaneAlign;
+        size_t needed = planeBytes * channels * numFrames;
+        if (needed > capacity_) {
+            std::free(storage_);
+            storage_ = (unsigned char*)std::aligned_alloc(kPlaneAlign, needed);
+            capacity_ = storage_ ? needed : 0;
+            if (!storage_) return false;
+        }
+        frames_.assign(numFrames, PlanarFrame());
+        for (int f = 0; f < numFrames; ++f) {
+            for (int c = 0; c < channels; ++c) frames_[f].plane[c] = storage_ + planeBytes * (f * channels + c);
+        }
+        return true;
+    }
+
+    int stride() const { return stride_; }
+    const PlanarFrame& frame(int f) const { return frames_[f]; }
+
+private:
+    unsigned char* storage_ = nullptr;
+    size_t capacity_ = 0;
+    int stride_ = 0;
+    std::vector<PlanarFrame> frames_;
+};
+
+// ==========================================
+//        DEINTERLEAVE / INTERLEAVE
+// ==========================================
+// 16 pixels of C channels are C vectors of 16 bytes. Splitting: plane c gathers
+// its byte from every vector with pshufb (0x80 = zero) and ORs the parts.
+// Merging is the reverse: output vector q gathers its bytes from each plane.
+struct PlanarShuffles {
+    alignas(16) unsigned char split[4][4][16];   // [plane][input vector][byte]
+    alignas(16) unsigned char merge[4][4][16];   // [output vector][plane][byte]
+};
+
+inline const PlanarShuffles& planarShuffles(int channels) {
+    static const std::vector<PlanarShuffles> tables = [] {
+        std::vector<PlanarShuffles> t(5);
+        for (int C = 2; C <= 4; ++C) {
+            for (int v = 0; v < C; ++v) {
+                for (int i = 0; i < 16; ++i) {
+                    for (int c = 0; c < C; ++c) {
+                        int src = i * C + c;   // pixel i of plane c in the interleaved stream
+                        t[C].split[c][v][i] = (src / 16 == v) ? (unsigned char)(src % 16) : 0x80;
+                        int dst = v * 16 + i;  // byte i of output vector v
+                        t[C].merge[v][c][i] = (dst % C == c) ? (unsigned char)(dst / C) : 0x80;
+                    }
+                }
+            }
+        }
+        return t;
+    }();
+    return tables[channels];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Both return the number of pixels done (a multiple of 16); the caller finishes the tail.
+__attribute__((target("ssse3")))
+inline int deinterleaveSpanSsse3(const unsigned char* in, unsigned char* const* planes, int n, int channels) {
+    const PlanarShuffles& s = planarShuffles(channels);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i v[4];
+        for (int k = 0; k < channels; ++k) v[k] = _mm_loadu_si128((const __m128i*)(in + (size_t)x * channels + 16 * k));
+        for (int c = 0; c < channels; ++c) {
+            __m128i r = _mm_setzero_si128();
+            for (int k = 0; k < channels; ++k) {
+                r = _mm_or_si128(r, _mm_shuffle_epi8(v[k], _mm_load_si128((const __m128i*)s.split[c][k])));
+            }
+            _mm_storeu_si128((__m128i*)(planes[c] + x), r);
+        }
+    }
+    return x;
+}
+
+__attribute__((target("ssse3")))
+inline int interleaveSpanSsse3(const unsigned char* const* planes, unsigned char* out, int n, int channels) {
+    const PlanarShuffles& s = planarShuffles(channels);
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i p[4];
+        for (int c = 0; c < channels; ++c) p[c] = _mm_loadu_si128((const __m128i*)(planes[c] + x));
+        for (int k = 0; k < channels; ++k) {
+            __m128i r = _mm_setzero_si128();
+            for (int c = 0; c < channels; ++c) {
+                r = _mm_or_si128(r, _mm_shuffle_epi8(p[c], _mm_load_si128((const __m128i*)s.merge[k][c])));
+            }
+            _mm_storeu_si128((__m128i*)(out + (size_t)x * channels + 16 * k), r);
+        }
+    }
+    return x;
+}
+#endif
+
+inline bool planarSimdAvailable() {
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    return ssse3;
+#else
+    return false;
+#endif
+}
+
+// Splits rows [startRow, endRow) of an interleaved image into 'frame'
+inline void deinterleaveRows(const unsigned char* img, const PlanarFrame& frame, int stride, int width, int channels, int startRow, int endRow) {
+    for (int y = startRow; y < endRow; ++y) {
+        const unsigned char* in = img + (size_t)y * width * channels;
+        unsigned char* planes[4];
+        for (int c = 0; c < channels; ++c) planes[c] = frame.plane[c] + (size_t)y * stride;
+        if (channels == 1) { std::memcpy(planes[0], in, width); continue; }
+
+        int x = 0;
+#if defined(__x86_64__) || defined(__i386__)
+        if (planarSimdAvailable()) x = deinterleaveSpanSsse3(in, planes, width, channels);
+#endif
+        for (; x < width; ++x) {
+            for (int c = 0; c < channels; ++c) planes[c][x] = in[x * channels + c];
+        }
+    }
+}
+
+// Joins rows [startRow, endRow) of 'frame' into an interleaved image
+inline void interleaveRows(const PlanarFrame& frame, unsigned char* out, int stride, int width, int channels, int startRow, int endRow) {
+    for (int y = startRow; y < endRow; ++y) {
+        unsigned char* o = out + (size_t)y * width * channels;
+        const unsigned char* planes[4];
+        for (int c = 0; c < channels; ++c) planes[c] = frame.plane[c] + (size_t)y * stride;
+        if (channels == 1) { std::memcpy(o, planes[0], width); continue; }
+
+        int x = 0;
+#if defined(__x86_64__) || defined(__i386__)
+        if (planarSimdAvailable()) x = interleaveSpanSsse3(planes, o, width, channels);
+#endif
+        for (; x < width; ++x) {
+            for (int c = 0; c < channels; ++c) o[x * channels + c] = planes[c][x];
+        }
+    }
+}
+
+// ==========================================
+//            PLANAR STAGE KERNELS
+// ==========================================
+// Same semantics as runStageRows(): grayscale writes Y to the first three
+// planes, stencils read outside samples through the stage's border rule, tone
+// stages copy alpha.
+inline void runPlanarStageRows(const StageSpec& stage, const PlanarFrame& in, const PlanarFrame& out, int stride, int width, int height, int channels, int s, int e) {
+    switch (stage.kind) {
+        case StageKind::Grayscale:
+            for (int y = s; y < e; ++y) {
+                size_t row = (size_t)y * stride;
+                if (channels < 3) {
+                    for (int c = 0; c < channels; ++c) {
+                        if (in.plane[c] != out.plane[c]) std::memcpy(out.plane[c] + row, in.plane[c] + row, width);
+                    }
+                    continue;
+                }
+                const unsigned char* r = in.plane[0] + row;
+                const unsigned char* g = in.plane[1] + row;
+                const unsigned char* b = in.plane[2] + row;
+                unsigned char* o0 = out.plane[0] + row;
+                unsigned char* o1 = out.plane[1] + row;
+                unsigned char* o2 = out.plane[2] + row;
+                for (int x = 0; x < width; ++x) {
+                    unsigned char gray = (unsigned char)(0.299f * r[x] + 0.587f * g[x] + 0.114f * b[x]);
+                    o0[x] = gray;
+                    o1[x] = gray;
+                    o2[x] = gray;
+                }
+                if (channels == 4 && in.plane[3] != out.plane[3]) std::memcpy(out.plane[3] + row, in.plane[3] + row, width);
+            }
+            break;
+        case StageKind::Blur:
+        case StageKind::Sharpen:
+        case StageKind::Convolve:
+        case StageKind::Edge:
+            for (int c = 0; c < channels; ++c) {
+                if (stage.kind == StageKind::Edge) {
+                    applyStencil(in.plane[c], out.plane[c], stride, width, height, 1, s, e, stage.border, sobelPixel);
+                } else {
+                    applyStencil(in.plane[c], out.plane[c], stride, width, height, 1, s, e, stage.border,
+                                 [&](const unsigned char* p, int st, int ch) { return convolvePixel(p, st, ch, stage.kernel); });
+                }
+            }
+            break;
+        case StageKind::Brightness:
+        case StageKind::Lut:
+        case StageKind::Contrast:
+        case StageKind::Gamma:
+        case StageKind::Threshold:
+            for (int c = 0; c < channels; ++c) {
+                bool alpha = (channels == 4 && c == 3);
+                for (int y = s; y < e; ++y) {
+                    const unsigned char* p = in.plane[c] + (size_t)y * stride;
+                    unsigned char* o = out.plane[c] + (size_t)y * stride;
+                    if (alpha) {
+                        if (p != o) std::memcpy(o, p, width);
+                    } else if (stage.kind == StageKind::Lut) {
+                        applyLookupTable(p, o, width, 1, 1, stage.lut.data(), 0, 1);
+                    } else if (stage.kind == StageKind::Brightness) {
+                        applyBrightness(p, o, width, 1, 1, stage.value, 0, 1);
+                    } else {
+                        for (int x = 0; x < width; ++x) o[x] = bytePixel(stage, p[x]);
+                    }
+                }
+            }
+            break;
+    }
+}
+
+// Runs the plan on planar frames: deinterleave, every step, interleave into 'output'.
+// Plane rows are always line aligned; 'alignRows' also aligns the cuts in 'output'.
+// Returns false if the workspace cannot be allocated.
+inline bool executePlanPlanar(Executor& exec, const Plan& plan, PlanarWorkspace& ws, const unsigned char* img, unsigned char* output, int width, int height, int channels, bool alignRows) {
+    int sourceFrame = plan.numBuffers;
+    if (!ws.prepare(width, height, channels, plan.numBuffers + 1)) return false;
+    int stride = ws.stride();
+    int grain = rowGrain(alignRows, (size_t)width * channels, height, exec.threads());
+    auto resolve = [&](int b) { return ws.frame(b == kSourceImage ? sourceFrame : b); };
+
+    exec.parallelFor(height, [&](int s, int e) {
+        deinterleaveRows(img, ws.frame(sourceFrame), stride, width, channels, s, e);
+    }, grain);
+
+    for (const PlanStep& step : plan.steps) {
+        PlanarFrame in = resolve(step.src);
+        PlanarFrame out = ws.frame(step.dst);
+        exec.parallelFor(height, [&](int s, int e) {
+            runPlanarStageRows(step.stages[0], in, out, stride, width, height, channels, s, e);
+            for (size_t k = 1; k < step.stages.size(); ++k) {
+                runPlanarStageRows(step.stages[k], out, out, stride, width, height, channels, s, e);
+            }
+        }, grain);
+    }
+
+    PlanarFrame result = resolve(plan.resultBuffer);
+    exec.parallelFor(height, [&](int s, int e) {
+        interleaveRows(result, output, stride, width, channels, s, e);
+    }, grain);
+    return true;
+}
+
+#endif // CST435_PLANAR_H
@@ -0,0 +1,304 @@
+/**
+ * @file processes.h
+ * @brief Forked worker processes sharing a lock-free work queue in a memfd segment (--processes)
+ * @course CST435: Parallel Computing
+ *
+ * One process with many threads shares one heap and one stdio lock, and a
+ * decoder that crashes on a malformed file takes the whole batch with it.
+ * With --processes=N the launcher scans the input folder, maps one entry per
+ * image into a shared memfd segment and forks N workers. Every worker runs
+ * the normal batch loop (its own executor, frame buffers and decoder arena)
+ * on the images it claims from the segment:
+ *   - an image is claimed by a CAS of its state from pending to the worker's
+ *     slot; fresh images come from a fetch_add cursor, requeued ones from a
+ *     retry list that only the launcher appends to
+ *   - each worker counts its images, failures, busy time and peak RSS in its
+ *     slot of the segment, where the launcher reads them for the report
+ *   - when a worker is killed by a signal, the launcher requeues the images
+ *     it had claimed and forks a replacement into the slot; an image that
+ *     has been held by kMaxAttempts dead workers is given up as failed
+ * Threads and the memory budget are split evenly between the workers.
+ */
+
+#ifndef CST435_PROCESSES_H
+#define CST435_PROCESSES_H
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "admission.h"
+#include "pages.h"
+
+const int kMaxAttempts = 2;
+
+// Queue entry states: a state >= 0 is the slot of the worker holding the image,
+// settled images hold kItemDone/kItemFailed/kItemSkipped (admission.h)
+const int32_t kItemPending = -1;
+
+static_assert(std::atomic<int32_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free,
+              "shared-memory atomics must be lock-free to work across processes");
+
+struct QueueItem {
+    std::atomic<int32_t> state{kItemPending};
+    std::atomic<int32_t> attempts{0};          // workers that died holding it
+};
+
+// Counters are updated by the slot's worker, pid/restarts/crashes/givenUp by the launcher.
+struct alignas(64) ProcessSlot {
+    std::atomic<int32_t> images{0}, failed{0}, skipped{0};
+    std::atomic<int64_t> busyMicros{0};        // decode + pipeline + save, over all of the slot's processes
+    std::atomic<int64_t> peakRssKB{0};
+    int32_t pid = 0;
+    int32_t restarts = 0;
+    int32_t crashes = 0;
+    int32_t givenUp = 0;                       // images failed because they outlived kMaxAttempts workers
+};
+
+struct alignas(64) QueueHeader {
+    std::atomic<uint32_t> next{0};                      // first image never handed out
+    std::atomic<uint32_t> retryHead{0}, retryTail{0};   // requeued images are retry[head, tail)
+};
+
+class WorkQueue : public WorkSource {
+public:
+    WorkQueue() = default;
+    WorkQueue(const WorkQueue&) = delete;
+    WorkQueue& operator=(const WorkQueue&) = delete;
+    ~WorkQueue() { if (base_) munmap(base_, bytes_); }
+
+    // Maps the segment for 'images' and 'slots' workers; workers forked afterwards share it.
+    bool create(const std::vector<ImageInfo>& images, int slots) {
+        images_ = images;
+        slots_ = slots;
+        size_t count = images.size();
+        auto line = [](size_t n) { return (n + 63) & ~(size_t)63; };
+        size_t slotsAt = line(sizeof(QueueHeader));
+        size_t itemsAt = slotsAt + line(slots * sizeof(ProcessSlot));
+        size_t retryAt = itemsAt + line(count * sizeof(QueueItem));
+        bytes_ = retryAt + std::max<size_t>(1, count * kMaxAttempts) * sizeof(uint32_t);
+
+        int fd = memfd_create("cst435-work-queue", MFD_CLOEXEC);
+        if (fd < 0) return false;
+        void* p = ftruncate(fd, (off_t)bytes_) == 0 ? mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);   // the mapping keeps the segment alive
+        if (p == MAP_FAILED) return false;
+
+        base_ = (unsigned char*)p;
+        header_ = new (base_) QueueHeader;
+        slot_ = (ProcessSlot*)(base_ + slotsAt);
+        for (int s = 0; s < slots; ++s) new (slot_ + s) ProcessSlot;
+        items_ = (QueueItem*)(base_ + itemsAt);
+        for (size_t i = 0; i < count; ++i) new (items_ + i) QueueItem;
+        retry_ = (uint32_t*)(base_ + retryAt);
+        return true;
+    }
+
+    size_t segmentBytes() const { return bytes_; }
+    int slots() const { return slots_; }
+    ProcessSlot& slot(int s) { return slot_[s]; }
+    const ImageInfo& image(uint32_t index) const { return images_[index]; }
+
+    // ------------------------------------------
+    //   Worker side (after fork)
+    // ------------------------------------------
+    void attach(int slot) { self_ = slot; }
+    int index() const override { return self_; }
+    std::string tag() const override { return "[p" + std::to_string(self_) + "] "; }
+
+    // Claims the next image for this worker: requeued images first, then fresh ones.
+    // False once neither is left.
+    bool claim(ImageInfo& info) override {
+        uint32_t head = header_->retryHead.load(std::memory_order_relaxed);
+        while (head < header_->retryTail.load(std::memory_order_acquire)) {
+            if (!header_->retryHead.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel)) continue;
+            if (take(retry_[head], info)) return true;
+            head = header_->retryHead.load(std::memory_order_relaxed);
+        }
+        while (true) {
+            uint32_t index = header_->next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= images_.size()) return false;
+            if (take(index, info)) return true;
+        }
+    }
+
+    // Settles a claimed image (kItemDone, kItemFailed or kItemSkipped) and counts it.
+    void finish(const ImageInfo& info, int32_t state) override {
+        items_[info.id].state.store(state, std::memory_order_release);
+        ProcessSlot& s = slot_[self_];
+        if (state == kItemDone) s.images.fetch_add(1, std::memory_order_relaxed);
+        else if (state == kItemSkipped) s.skipped.fetch_add(1, std::memory_order_relaxed);
+        else s.failed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Adds a group's wall time to this worker's busy time and refreshes its peak RSS.
+    void recordBusy(double seconds) override {
+        ProcessSlot& s = slot_[self_];
+        s.busyMicros.fetch_add((int64_t)(seconds * 1e6), std::memory_order_relaxed);
+        s.peakRssKB.store(std::max<int64_t>(s.peakRssKB.load(std::memory_order_relaxed), peakRssKilobytes()), std::memory_order_relaxed);
+    }
+
+    // ------------------------------------------
+    //   Launcher side
+    // ------------------------------------------
+    // True while images remain to be handed out.
+    bool hasWork() const {
+        return header_->next.load(std::memory_order_acquire) < images_.size()
+            || header_->retryHead.load(std::memory_order_acquire) < header_->retryTail.load(std::memory_order_acquire);
+    }
+
+    // The worker in 'slot' has died: its claimed images go back on the retry list.
+    // Images it was already the kMaxAttempts-th dead holder of are marked failed
+    // and appended to 'givenUp'. Returns the number requeued.
+    int requeueHeld(int slot, std::vector<uint32_t>& givenUp) {
+        int requeued = 0;
+        for (uint32_t i = 0; i < images_.size(); ++i) {
+            if (items_[i].state.load(std::memory_order_acquire) == slot) requeued += requeue(i, givenUp);
+        }
+        return requeued;
+    }
+
+    // With no worker alive: images handed out by the cursor or the retry list but never
+    // claimed (their worker died in between) go back on the retry list.
+    int requeueLost(std::vector<uint32_t>& givenUp) {
+        std::vector<bool> queued(images_.size(), false);
+        uint32_t tail = header_->retryTail.load(std::memory_order_acquire);
+        for (uint32_t h = header_->retryHead.load(std::memory_order_acquire); h < tail; ++h) queued[retry_[h]] = true;
+        uint32_t handedOut = (uint32_t)std::min<size_t>(header_->next.load(std::memory_order_acquire), images_.size());
+        int requeued = 0;
+        for (uint32_t i = 0; i < handedOut; ++i) {
+            if (!queued[i] && items_[i].state.load(std::memory_order_acquire) == kItemPending) requeued += requeue(i, givenUp);
+        }
+        return requeued;
+    }
+
+    // Images never settled (left over when workers could not be replaced).
+    int unsettled() const {
+        int n = 0;
+        for (uint32_t i = 0; i < images_.size(); ++i) n += items_[i].state.load(std::memory_order_acquire) >= kItemPending;
+        return n;
+    }
+
+private:
+    bool take(uint32_t index, ImageInfo& info) {
+        int32_t pending = kItemPending;
+        if (!items_[index].state.compare_exchange_strong(pending, self_, std::memory_order_acq_rel)) return false;
+        info = images_[index];
+        return true;
+    }
+
+    // Only the launcher appends, so the tail is published with a plain release store.
+    int requeue(uint32_t index, std::vector<uint32_t>& givenUp) {
+        QueueItem& item = items_[index];
+        uint32_t tail = header_->retryTail.load(std::memory_order_relaxed);
+        if (item.attempts.fetch_add(1, std::memory_order_relaxed) + 1 >= kMaxAttempts || tail >= images_.size() * kMaxAttempts) {
+            item.state.store(kItemFailed, std::memory_order_release);
+            givenUp.push_back(index);
+            return 0;
+        }
+        item.state.store(kItemPending, std::memory_order_release);
+        retry_[tail] = index;
+        header_->retryTail.store(tail + 1, std::memory_order_release);
+        return 1;
+    }
+
+    std::vector<ImageInfo> images_;    // process-local copy, inherited by every worker
+    int slots_ = 0;
+    int self_ = -1;                    // this worker's slot (-1 in the launcher)
+    unsigned char* base_ = nullptr;
+    size_t bytes_ = 0;
+    QueueHeader* header_ = nullptr;
+    ProcessSlot* slot_ = nullptr;
+    QueueItem* items_ = nullptr;
+    uint32_t* retry_ = nullptr;
+};
+
+// ==========================================
+//              WORKER SUPERVISION
+// ==========================================
+// Forks one worker per slot running work(slot) and waits until every image is settled.
+// A worker killed by a signal has its images requeued and is replaced in its slot
+// (at most kMaxAttempts replacements per image, so a crashing file cannot loop forever).
+inline void superviseWorkers(WorkQueue& queue, const std::function<int(int)>& work) {
+    int live = 0;
+    int replacements = 0;
+    const int maxReplacements = queue.slots() + (int)queue.unsettled() * kMaxAttempts;
+
+    auto spawn = [&](int slot) {
+        std::cout.flush();   // the child would write the launcher's buffered output again
+        pid_t pid = fork();
+        if (pid == 0) {
+            queue.attach(slot);
+            int code = work(slot);
+            std::cout.flush();
+            _exit(code);
+        }
+        if (pid < 0) {
+            std::cout << "[launcher] fork failed for p" << slot << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        queue.slot(slot).pid = pid;
+        live++;
+    };
+    auto replace = [&](int slot) {
+        if (!queue.hasWork() || replacements >= maxReplacements) return;
+        replacements++;
+        queue.slot(slot).restarts++;
+        spawn(slot);
+    };
+    auto reportGivenUp = [&](const std::vector<uint32_t>& givenUp) {
+        for (uint32_t i : givenUp) {
+            std::cout << "Processing: " << queue.image(i).filename << " ... Held by " << kMaxAttempts << " crashed workers, given up." << std::endl;
+        }
+    };
+
+    for (int s = 0; s < queue.slots(); ++s) spawn(s);
+    while (live > 0) {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int slot = -1;
+        for (int s = 0; s < queue.slots(); ++s) if (queue.slot(s).pid == pid) slot = s;
+        if (slot < 0) continue;
+        live--;
+
+        std::vector<uint32_t> givenUp;
+        if (WIFSIGNALED(status)) {
+            queue.slot(slot).crashes++;
+            int requeued = queue.requeueHeld(slot, givenUp);
+            queue.slot(slot).givenUp += (int)givenUp.size();
+            std::cout << "[launcher] p" << slot << " (pid " << pid << ") killed by signal " << WTERMSIG(status)
+                      << " (" << strsignal(WTERMSIG(status)) << "), " << requeued << " image(s) requeued, "
+                      << givenUp.size() << " given up" << std::endl;
+            reportGivenUp(givenUp);
+            replace(slot);
+        } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            std::cout << "[launcher] p" << slot << " (pid " << pid << ") exited with status " << WEXITSTATUS(status) << std::endl;
+        }
+
+        if (live == 0) {
+            givenUp.clear();
+            int lost = queue.requeueLost(givenUp);
+            queue.slot(slot).givenUp += (int)givenUp.size();
+            if (lost > 0) std::cout << "[launcher] " << lost << " image(s) handed out but never claimed, requeued" << std::endl;
+            reportGivenUp(givenUp);
+            replace(slot);
+        }
+    }
+}
+
+#endif // CST435_PROCESSES_H
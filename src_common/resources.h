@@ -0,0 +1,177 @@
+/**
+ * @file resources.h
+ * @brief CPU and memory limits of the container (cgroup v1/v2) for automatic sizing
+ * @course CST435: Parallel Computing
+ *
+ * std::thread::hardware_concurrency() reports the host's CPUs, not what a
+ * container may use. When no thread count is given the batch processor sizes
+ * itself from:
+ *   - the CPU quota      : cpu.max (v2) or cpu.cfs_quota_us / cpu.cfs_period_us (v1)
+ *   - the cpuset         : the process affinity mask (cpuset.cpus.effective)
+ *   - the memory limit   : memory.max (v2) or memory.limit_in_bytes (v1)
+ * Every level from the process's cgroup up to the root is checked and the
+ * tightest limit wins, as nested Kubernetes cgroups may set any of them.
+ * The memory budget caps the frame buffers, so a small pod skips oversized
+ * images instead of being OOM-killed.
+ */
+
+#ifndef CST435_RESOURCES_H
+#define CST435_RESOURCES_H
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pipeline.h"
+
+struct ResourceLimits {
+    int hardwareThreads = 1;        // logical CPUs of the host
+    int cpusetThreads = 1;          // CPUs in the affinity mask / cpuset
+    double cpuQuota = 0.0;          // CPUs worth of quota, 0 = unlimited
+    size_t memoryLimit = 0;         // bytes, 0 = unlimited
+    size_t physicalMemory = 0;      // MemTotal
+};
+
+// "hierarchy:controllers:path" lines of /proc/self/cgroup.
+struct CgroupEntry {
+    std::string controllers;
+    std::string path;
+};
+
+inline std::vector<CgroupEntry> selfCgroups() {
+    std::vector<CgroupEntry> entries;
+    std::ifstream file("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t a = line.find(':'), b = line.find(':', a + 1);
+        if (a == std::string::npos || b == std::string::npos) continue;
+        entries.push_back({line.substr(a + 1, b - a - 1), line.substr(b + 1)});
+    }
+    return entries;
+}
+
+// Directories to check for one controller, innermost first: the process's cgroup
+// and every parent up to the mount root. Inside a cgroup namespace the path is
+// already relative to the mount, so it is tried as given.
+inline std::vector<std::string> cgroupDirs(const std::string& mount, const std::string& path) {
+    std::vector<std::string> dirs;
+    std::string p = path;
+    while (true) {
+        std::string dir = mount + (p == "/" ? "" : p);
+        if (std::filesystem::exists(dir)) dirs.push_back(dir);
+        if (p.empty() || p == "/") break;
+        size_t slash = p.find_last_of('/');
+        p = slash == 0 ? "/" : p.substr(0, slash);
+    }
+    return dirs;
+}
+
+// Mount point of a v1 controller ("cpu", "memory"), given its co-mounted list ("cpu,cpuacct").
+inline std::string cgroupV1Mount(const std::string& controllers, const std::string& wanted) {
+    for (const std::string& name : {controllers, wanted}) {
+        std::string dir = "/sys/fs/cgroup/" + name;
+        if (std::filesystem::exists(dir)) return dir;
+    }
+    return "";
+}
+
+inline bool hasController(const std::string& controllers, const std::string& wanted) {
+    std::istringstream list(controllers);
+    std::string name;
+    while (std::getline(list, name, ',')) if (name == wanted) return true;
+    return false;
+}
+
+inline ResourceLimits detectResourceLimits() {
+    ResourceLimits r;
+    r.hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t mask;
+    r.cpusetThreads = sched_getaffinity(0, sizeof(mask), &mask) == 0 ? std::max(1, CPU_COUNT(&mask)) : r.hardwareThreads;
+
+    long pages = sysconf(_SC_PHYS_PAGES), pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && pageSize > 0) r.physicalMemory = (size_t)pages * pageSize;
+
+    // v1 reports "no limit" as a huge page-rounded number
+    const uint64_t kUnlimited = 1ull << 60;
+    auto tighterMemory = [&](uint64_t bytes) {
+        if (bytes > 0 && bytes < kUnlimited && (r.memoryLimit == 0 || bytes < r.memoryLimit)) r.memoryLimit = bytes;
+    };
+    auto tighterQuota = [&](double cpus) {
+        if (cpus > 0 && (r.cpuQuota == 0 || cpus < r.cpuQuota)) r.cpuQuota = cpus;
+    };
+
+    for (const CgroupEntry& e : selfCgroups()) {
+        if (e.controllers.empty()) {
+            // v2 unified hierarchy (on hybrid hosts it may only carry pressure files)
+            for (const std::string& dir : cgroupDirs(std::filesystem::exists("/sys/fs/cgroup/unified") ? "/sys/fs/cgroup/unified" : "/sys/fs/cgroup", e.path)) {
+                std::istringstream cpu(readFirstLine(dir + "/cpu.max"));
+                std::string quota;
+                double period = 0;
+                if (cpu >> quota >> period && quota != "max" && period > 0) tighterQuota(std::atof(quota.c_str()) / period);
+                std::string mem = readFirstLine(dir + "/memory.max");
+                if (!mem.empty() && mem != "max") tighterMemory(std::strtoull(mem.c_str(), nullptr, 10));
+            }
+            continue;
+        }
+        if (hasController(e.controllers, "cpu")) {
+            std::string mount = cgroupV1Mount(e.controllers, "cpu");
+            for (const std::string& dir : mount.empty() ? std::vector<std::string>() : cgroupDirs(mount, e.path)) {
+                long quota = std::atol(readFirstLine(dir + "/cpu.cfs_quota_us").c_str());
+                long period = std::atol(readFirstLine(dir + "/cpu.cfs_period_us").c_str());
+                if (quota > 0 && period > 0) tighterQuota((double)quota / period);
+            }
+        }
+        if (hasController(e.controllers, "memory")) {
+            std::string mount = cgroupV1Mount(e.controllers, "memory");
+            for (const std::string& dir : mount.empty() ? std::vector<std::string>() : cgroupDirs(mount, e.path)) {
+                tighterMemory(std::strtoull(readFirstLine(dir + "/memory.limit_in_bytes").c_str(), nullptr, 10));
+            }
+        }
+    }
+    return r;
+}
+
+// Workers that can actually run at the same time: the cpuset, capped by the quota.
+// The quota is rounded down (but at least 1): a worker that only gets part of each
+// period is throttled while it still holds rows that the next stage waits for.
+inline int autoThreadCount(const ResourceLimits& r) {
+    int threads = r.cpusetThreads;
+    if (r.cpuQuota > 0) threads = std::min(threads, std::max(1, (int)std::floor(r.cpuQuota + 1e-6)));
+    return std::max(1, threads);
+}
+
+// Bytes the frame buffers and in-flight images may use: 80% of the tighter of the
+// cgroup limit and physical memory (the rest covers code, stacks, the encoder and
+// page cache), minus what the process already uses. 0 = no limit known.
+inline size_t memoryBudget(const ResourceLimits& r) {
+    size_t limit = r.memoryLimit;
+    if (r.physicalMemory && (limit == 0 || r.physicalMemory < limit)) limit = r.physicalMemory;
+    if (limit == 0) return 0;
+    long residentPages = 0;
+    std::istringstream statm(readFirstLine("/proc/self/statm"));
+    long ignored;
+    statm >> ignored >> residentPages;
+    size_t resident = (size_t)std::max(0L, residentPages) * sysconf(_SC_PAGE_SIZE);
+    size_t usable = limit / 10 * 8;
+    return usable > resident ? usable - resident : kPageBytes;
+}
+
+inline std::string describeLimits(const ResourceLimits& r) {
+    std::ostringstream out;
+    out << "cpuset " << r.cpusetThreads << "/" << r.hardwareThreads << " CPUs";
+    if (r.cpuQuota > 0) out << ", quota " << r.cpuQuota << " CPUs";
+    if (r.memoryLimit > 0) out << ", memory limit " << (r.memoryLimit >> 20) << " MB";
+    if (r.cpuQuota == 0 && r.memoryLimit == 0) out << ", no cgroup limits";
+    return out.str();
+}
+
+#endif // CST435_RESOURCES_H
@@ -0,0 +1,149 @@
+/**
+ * @file runner.h
+ * @brief Runs one decoded image through the compiled plan in the selected mode
+ * @course CST435: Parallel Computing
+ *
+ * The batch loop and the autotuner both need "run this image with these
+ * execution settings"; this header is the single place that dispatches to
+ * the plain row kernels, a schedule (schedule.h), the tile DAG (tile_dag.h)
+ * or the planar layout (planar.h).
+ */
+
+#ifndef CST435_RUNNER_H
+#define CST435_RUNNER_H
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "jit.h"
+#include "pages.h"
+#include "pipeline.h"
+#include "planar.h"
+#include "schedule.h"
+#include "tile_dag.h"
+
+inline bool isImageFile(const std::string& path) {
+    return path.find(".jpg") != std::string::npos ||
+           path.find(".jpeg") != std::string::npos ||
+           path.find(".png") != std::string::npos;
+}
+
+struct ExecutionMode {
+    std::vector<StageSpec> stages;
+    Plan plan;
+    bool useSchedule = false;
+    Schedule schedule;
+    int dagTileRows = 0;                      // > 0 = tile DAG
+    std::shared_ptr<PlanarWorkspace> planar;  // non-null = planar layout
+    bool alignRows = true;                    // cut work at cache-line aligned rows (false = every kRowGrain rows)
+    size_t streamAbove = defaultStreamThreshold();  // frame bytes from which point steps use non-temporal stores
+};
+
+// Builds the mode from the textual settings. Returns false and fills 'error' if invalid.
+// A non-empty 'jitCacheDir' replaces convolution stages with runtime-specialised kernels.
+// 'layout' is "interleaved" (or empty) or "planar"; 'border' is a parseBorder() spec (empty = clamp).
+inline bool configureExecution(const std::string& pipeline, const std::string& schedule, int dagTileRows, const std::string& jitCacheDir, const std::string& layout, const std::string& border, ExecutionMode& mode, std::string& error) {
+    if (!parsePipelineSpec(pipeline, mode.stages, error)) {
+        error = "Invalid pipeline: " + error;
+        return false;
+    }
+    Border rule;
+    if (!border.empty() && !parseBorder(border, rule, error)) {
+        error = "Invalid border: " + error;
+        return false;
+    }
+    for (StageSpec& stage : mode.stages) stage.border = rule;
+    mode.stages = composeLookupTables(mode.stages);
+    if (!jitCacheDir.empty() && !specializeStages(mode.stages, jitCacheDir, error)) {
+        error = "JIT: " + error;
+        return false;
+    }
+    mode.plan = compilePlan(mode.stages);
+
+    mode.useSchedule = !schedule.empty();
+    if (mode.useSchedule && !parseSchedule(schedule, mode.schedule, error)) {
+        error = "Invalid schedule: " + error;
+        return false;
+    }
+    if (mode.useSchedule && dagTileRows > 0) {
+        error = "--dag runs the plain row kernels and cannot be combined with --schedule";
+        return false;
+    }
+    if (mode.useSchedule && mode.schedule.computeAtTile && rule.mode == BorderMode::Wrap) {
+        error = "wrap borders read the far side of the image, which fused (compute_at) tiles do not hold";
+        return false;
+    }
+    mode.dagTileRows = dagTileRows;
+
+    if (layout == "planar") {
+        if (mode.useSchedule || dagTileRows > 0 || !jitCacheDir.empty()) {
+            error = "--layout=planar runs its own plane kernels and cannot be combined with --schedule, --dag or --jit";
+            return false;
+        }
+        mode.planar = std::make_shared<PlanarWorkspace>();
+    } else if (!layout.empty() && layout != "interleaved") {
+        error = "Unknown layout '" + layout + "' (use interleaved or planar)";
+        return false;
+    }
+    return true;
+}
+
+// Recompiles the plan so stencils overwrite their input (a single frame buffer for any
+// chain). Only the plain row executor runs in-place stencils.
+inline bool enableInPlaceStencils(ExecutionMode& mode, std::string& error) {
+    if (mode.useSchedule || mode.dagTileRows > 0 || mode.planar) {
+        error = "--in-place runs stencils over a rolling line buffer in the plain row executor and cannot be combined with --schedule, --dag or --layout=planar";
+        return false;
+    }
+    mode.plan = compilePlan(mode.stages, true);
+    return true;
+}
+
+// Intermediate frame buffers the mode needs.
+// The planar layout keeps its planes in the workspace and only needs the interleaved result frame.
+inline int executionBuffers(const ExecutionMode& mode) {
+    if (mode.planar) return 1;
+    return mode.useSchedule ? scheduleBuffers(mode.schedule, mode.plan) : mode.plan.numBuffers;
+}
+
+// Returns the buffer holding the final image (nullptr if planar buffers cannot be allocated).
+inline const unsigned char* runImage(Executor& exec, const ExecutionMode& mode, const unsigned char* img, unsigned char* const* buffers, int width, int height, int channels) {
+    if (mode.planar) {
+        if (!executePlanPlanar(exec, mode.plan, *mode.planar, img, buffers[0], width, height, channels, mode.alignRows)) return nullptr;
+        return buffers[0];
+    }
+    if (mode.useSchedule) {
+        return executeSchedule(exec, mode.schedule, mode.stages, mode.plan, img, buffers, width, height, channels);
+    }
+    if (mode.dagTileRows > 0) {
+        int tileRows = mode.dagTileRows;
+        if (mode.alignRows) {
+            int unit = alignedRowGrain((size_t)width * channels, height, exec.threads());
+            tileRows = (tileRows + unit - 1) / unit * unit;
+        }
+        TileGraph graph = buildTileGraph(mode.plan, height, tileRows);
+        executeTileGraph(exec, graph, mode.plan, img, buffers, width, height, channels);
+        return buffers[mode.plan.resultBuffer];
+    }
+    return executePlan(exec, mode.plan, img, buffers, width, height, channels, mode.alignRows, mode.streamAbove);
+}
+
+// Runs several images. The plain row executor shares each step's parallel region between
+// them; the other modes run the images one after another. Returns false if any image failed.
+inline bool runImageBatch(Executor& exec, const ExecutionMode& mode, std::vector<BatchImage>& batch) {
+    if (batch.size() > 1 && !mode.useSchedule && mode.dagTileRows == 0 && !mode.planar) {
+        executePlanBatch(exec, mode.plan, batch, mode.alignRows, mode.streamAbove);
+        return true;
+    }
+    bool ok = true;
+    for (BatchImage& im : batch) {
+        im.result = runImage(exec, mode, im.img, im.buffers.data(), im.width, im.height, im.channels);
+        ok = ok && im.result;
+    }
+    return ok;
+}
+
+#endif // CST435_RUNNER_H
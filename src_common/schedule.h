@@ -0,0 +1,304 @@
+/**
+ * @file schedule.h
+ * @brief Halide-style schedules: how the pipeline's loops are executed
+ * @course CST435: Parallel Computing
+ *
+ * The algorithm (what each stage computes per pixel) lives in filters.h and
+ * the stage list in pipeline.h. A Schedule only describes the loop nest:
+ *   - tile size          : tileWidth x tileHeight pixels per work unit (width 0 = full rows)
+ *   - parallel axis      : tile rows, individual tiles, or none (serial)
+ *   - vectorize          : strip-mine x by N pixels with the channel loop hoisted out,
+ *                          so the innermost loop is a unit-step run the compiler can vectorize
+ *   - compute_at(tile)   : "fuse" computes every stage for one output tile before moving on,
+ *                          recomputing the 1-pixel halo each stencil needs, instead of
+ *                          materialising every stage over the whole frame (compute_root)
+ *
+ * Presets: rows, tiles, fused, fused-vec; or a custom spec such as
+ *   --schedule="tile=128x32,parallel=tiles,vector=16,fuse"
+ *
+ * Stencil border pixels follow the stage's Border rule, as in the row kernels.
+ * compute_at tiles only hold their halo, so wrap borders need compute_root.
+ */
+
+#ifndef CST435_SCHEDULE_H
+#define CST435_SCHEDULE_H
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "filters.h"
+#include "pipeline.h"
+
+// ==========================================
+//              SCHEDULE OBJECT
+// ==========================================
+enum class ParallelAxis { TileRows, Tiles, None };
+
+struct Schedule {
+    std::string name = "rows";
+    int tileWidth = 0;                        // 0 = whole image width
+    int tileHeight = 8;
+    ParallelAxis parallel = ParallelAxis::TileRows;
+    int vectorWidth = 1;                      // 1 = scalar x/c loop
+    bool computeAtTile = false;               // false = compute_root per stage
+};
+
+inline bool presetSchedule(const std::string& name, Schedule& s) {
+    s = Schedule();
+    s.name = name;
+    if (name == "rows") return true;
+    if (name == "tiles") { s.tileWidth = 64; s.tileHeight = 64; s.parallel = ParallelAxis::Tiles; return true; }
+    if (name == "fused") { s.tileWidth = 256; s.tileHeight = 32; s.parallel = ParallelAxis::Tiles; s.computeAtTile = true; return true; }
+    if (name == "fused-vec") { s.tileWidth = 256; s.tileHeight = 32; s.parallel = ParallelAxis::Tiles; s.computeAtTile = true; s.vectorWidth = 16; return true; }
+    return false;
+}
+
+inline std::vector<std::string> presetScheduleNames() {
+    return {"rows", "tiles", "fused", "fused-vec"};
+}
+
+// Accepts a preset name or comma separated key=value pairs (see file header).
+inline bool parseSchedule(const std::string& text, Schedule& s, std::string& error) {
+    if (presetSchedule(text, s)) return true;
+
+    s = Schedule();
+    s.name = text;
+    std::istringstream tokens(text);
+    std::string token;
+    while (std::getline(tokens, token, ',')) {
+        token = trim(token);
+        std::string key = token.substr(0, token.find('='));
+        std::string value = token.find('=') == std::string::npos ? "" : token.substr(token.find('=') + 1);
+
+        if (key == "tile") {
+            size_t x = value.find('x');
+            if (x == std::string::npos) { error = "tile must be WxH (W may be 0 for full rows)"; return false; }
+            s.tileWidth = std::atoi(value.substr(0, x).c_str());
+            s.tileHeight = std::atoi(value.substr(x + 1).c_str());
+            if (s.tileWidth < 0 || s.tileHeight < 1) { error = "invalid tile size '" + value + "'"; return false; }
+        } else if (key == "parallel") {
+            if (value == "rows") s.parallel = ParallelAxis::TileRows;
+            else if (value == "tiles") s.parallel = ParallelAxis::Tiles;
+            else if (value == "none") s.parallel = ParallelAxis::None;
+            else { error = "parallel must be rows|tiles|none"; return false; }
+        } else if (key == "vector") {
+            s.vectorWidth = std::atoi(value.c_str());
+            if (s.vectorWidth < 1) { error = "vector width must be >= 1"; return false; }
+        } else if (key == "fuse" && value.empty()) {
+            s.computeAtTile = true;
+        } else {
+            error = "unknown schedule setting '" + token + "' (or preset: rows|tiles|fused|fused-vec)";
+            return false;
+        }
+    }
+    return true;
+}
+
+inline std::string describeSchedule(const Schedule& s) {
+    std::ostringstream out;
+    out << s.name << " (tile " << (s.tileWidth ? std::to_string(s.tileWidth) : std::string("full"))
+        << "x" << s.tileHeight << ", parallel "
+        << (s.parallel == ParallelAxis::TileRows ? "rows" : s.parallel == ParallelAxis::Tiles ? "tiles" : "none")
+        << ", vector " << s.vectorWidth << ", " << (s.computeAtTile ? "compute_at tile" : "compute_root") << ")";
+    return out.str();
+}
+
+// ==========================================
+//         LOOP NEST GENERATION HELPERS
+// ==========================================
+struct Region { int x0, y0, x1, y1; };
+
+// A stage output: pixel (x, y) lives at data + (y - oy) * stride + (x - ox) * channels.
+struct View {
+    unsigned char* data;
+    int stride;
+    int ox, oy;
+    unsigned char* at(int x, int y, int channels) const {
+        return data + (size_t)(y - oy) * stride + (size_t)(x - ox) * channels;
+    }
+};
+
+// Innermost loops over [xs, xe) of one row: scalar (x then c) or vectorized
+// (c hoisted out, unit-step x strips of 'vectorWidth' pixels).
+template <typename PixelFn>
+inline void evalSpan(int xs, int xe, int channels, int vectorWidth, PixelFn fn) {
+    if (vectorWidth <= 1) {
+        for (int x = xs; x < xe; ++x)
+            for (int c = 0; c < channels; ++c) fn(x, c);
+        return;
+    }
+    for (int x0 = xs; x0 < xe; x0 += vectorWidth) {
+        int x1 = std::min(xe, x0 + vectorWidth);
+        for (int c = 0; c < channels; ++c) {
+            #pragma GCC ivdep
+            for (int x = x0; x < x1; ++x) fn(x, c);
+        }
+    }
+}
+
+// Evaluates one stage over region r, reading 'in' and writing 'out'.
+inline void evalStage(const StageSpec& stage, const View& in, const View& out, Region r, int width, int height, int channels, int vectorWidth) {
+    for (int y = r.y0; y < r.y1; ++y) {
+        const unsigned char* src = in.at(0, y, channels);
+        unsigned char* dst = out.at(0, y, channels);
+
+        switch (stage.kind) {
+            case StageKind::Grayscale:
+                if (channels < 3) {
+                    evalSpan(r.x0, r.x1, channels, vectorWidth, [&](int x, int c) { dst[x * channels + c] = src[x * channels + c]; });
+                } else {
+                    // One gray value per pixel (not per channel) so the stage is safe to run in place
+                    evalSpan(r.x0, r.x1, 1, vectorWidth, [&](int x, int) {
+                        const unsigned char* px = src + x * channels;
+                        unsigned char gray = grayscalePixel(px, 0);
+                        unsigned char alpha = (channels == 4) ? px[3] : 0;
+                        dst[x * channels] = gray;
+                        dst[x * channels + 1] = gray;
+                        dst[x * channels + 2] = gray;
+                        if (channels == 4) dst[x * channels + 3] = alpha;
+                    });
+                }
+                break;
+
+            case StageKind::Brightness:
+                evalSpan(r.x0, r.x1, channels, vectorWidth, [&](int x, int c) {
+                    unsigned char v = src[x * channels + c];
+                    dst[x * channels + c] = (channels == 4 && c == 3) ? v : brightnessPixel(v, stage.value);
+                });
+                break;
+
+            case StageKind::Lut:
+            case StageKind::Contrast:
+            case StageKind::Gamma:
+            case StageKind::Threshold:
+                evalSpan(r.x0, r.x1, channels, vectorWidth, [&](int x, int c) {
+                    unsigned char v = src[x * channels + c];
+                    dst[x * channels + c] = (channels == 4 && c == 3) ? v : bytePixel(stage, v);
+                });
+                break;
+
+            case StageKind::Blur:
+            case StageKind::Sharpen:
+            case StageKind::Convolve:
+            case StageKind::Edge: {
+                // Image border pixels take the peeled path through the stage's border rule
+                bool edge = stage.kind == StageKind::Edge;
+                const unsigned char* origin = in.at(0, 0, channels);
+                auto borderPixel = [&](int x, int c) {
+                    unsigned char win[9];
+                    gatherWindow(origin, in.stride, width, height, channels, x, y, c, stage.border, win);
+                    dst[x * channels + c] = edge ? sobelPixel(win + 4, 3, 1) : convolvePixel(win + 4, 3, 1, stage.kernel);
+                };
+                if (y == 0 || y == height - 1) {
+                    evalSpan(r.x0, r.x1, channels, 1, borderPixel);
+                    break;
+                }
+                int xs = std::max(r.x0, 1), xe = std::min(r.x1, width - 1);
+                if (r.x0 == 0) evalSpan(0, 1, channels, 1, borderPixel);
+                if (r.x1 == width && width > 1) evalSpan(width - 1, width, channels, 1, borderPixel);
+                int stride = in.stride;
+                if (edge) {
+                    evalSpan(xs, xe, channels, vectorWidth, [&](int x, int c) { dst[x * channels + c] = sobelPixel(src + x * channels + c, stride, channels); });
+                } else {
+                    evalSpan(xs, xe, channels, vectorWidth, [&](int x, int c) { dst[x * channels + c] = convolvePixel(src + x * channels + c, stride, channels, stage.kernel); });
+                }
+                break;
+            }
+        }
+    }
+}
+
+// ==========================================
+//            SCHEDULED EXECUTION
+// ==========================================
+// Intermediate frame buffers a schedule needs (compute_at keeps intermediates in tile scratch).
+inline int scheduleBuffers(const Schedule& s, const Plan& plan) {
+    return s.computeAtTile ? 1 : plan.numBuffers;
+}
+
+// Distributes tiles over the executor along the schedule's parallel axis.
+inline void forEachTile(Executor& exec, const Schedule& s, int width, int height, const std::function<void(Region)>& tileFn) {
+    int tw = s.tileWidth > 0 ? std::min(s.tileWidth, width) : width;
+    int th = std::min(s.tileHeight, height);
+    int tilesX = (width + tw - 1) / tw;
+    int tilesY = (height + th - 1) / th;
+
+    auto tile = [&](int tx, int ty) {
+        tileFn({tx * tw, ty * th, std::min(width, (tx + 1) * tw), std::min(height, (ty + 1) * th)});
+    };
+    auto tileRows = [&](int begin, int end) {
+        for (int ty = begin; ty < end; ++ty)
+            for (int tx = 0; tx < tilesX; ++tx) tile(tx, ty);
+    };
+
+    switch (s.parallel) {
+        case ParallelAxis::None:     tileRows(0, tilesY); break;
+        case ParallelAxis::TileRows: exec.parallelFor(tilesY, tileRows); break;
+        case ParallelAxis::Tiles:
+            exec.parallelFor(tilesX * tilesY, [&](int begin, int end) {
+                for (int t = begin; t < end; ++t) tile(t % tilesX, t / tilesX);
+            });
+            break;
+    }
+}
+
+// compute_root: every step of the plan runs over the whole frame before the next starts.
+inline const unsigned char* runRootSchedule(Executor& exec, const Schedule& s, const Plan& plan, const unsigned char* img, unsigned char* const* buffers, int width, int height, int channels) {
+    int stride = width * channels;
+    auto view = [&](int b) { return View{b == kSourceImage ? (unsigned char*)img : buffers[b], stride, 0, 0}; };
+
+    for (const PlanStep& step : plan.steps) {
+        View in = view(step.src), out = view(step.dst);
+        forEachTile(exec, s, width, height, [&](Region r) {
+            evalStage(step.stages[0], in, out, r, width, height, channels, s.vectorWidth);
+            for (size_t k = 1; k < step.stages.size(); ++k) evalStage(step.stages[k], out, out, r, width, height, channels, s.vectorWidth);
+        });
+    }
+    return plan.resultBuffer == kSourceImage ? img : buffers[plan.resultBuffer];
+}
+
+// compute_at(tile): for each output tile, walk the stages backwards to find the region
+// each one must produce (one extra pixel per downstream stencil), then compute the
+// chain forwards in per-worker scratch. Only the last stage writes the frame buffer.
+inline const unsigned char* runFusedSchedule(Executor& exec, const Schedule& s, const std::vector<StageSpec>& stages, const unsigned char* img, unsigned char* const* buffers, int width, int height, int channels) {
+    int n = (int)stages.size();
+    View source{(unsigned char*)img, width * channels, 0, 0};
+    View result{buffers[0], width * channels, 0, 0};
+
+    forEachTile(exec, s, width, height, [&](Region tile) {
+        static thread_local std::vector<unsigned char> scratch[2];
+
+        std::vector<Region> regions(n);
+        regions[n - 1] = tile;
+        for (int k = n - 1; k > 0; --k) {
+            int halo = isPointStage(stages[k].kind) ? 0 : 1;
+            Region r = regions[k];
+            regions[k - 1] = {std::max(0, r.x0 - halo), std::max(0, r.y0 - halo), std::min(width, r.x1 + halo), std::min(height, r.y1 + halo)};
+        }
+
+        View in = source;
+        for (int k = 0; k < n; ++k) {
+            const Region& r = regions[k];
+            View out = result;
+            if (k < n - 1) {
+                std::vector<unsigned char>& buf = scratch[k % 2];
+                int stride = (r.x1 - r.x0) * channels;
+                buf.resize((size_t)stride * (r.y1 - r.y0));
+                out = View{buf.data(), stride, r.x0, r.y0};
+            }
+            evalStage(stages[k], in, out, r, width, height, channels, s.vectorWidth);
+            in = out;
+        }
+    });
+    return buffers[0];
+}
+
+inline const unsigned char* executeSchedule(Executor& exec, const Schedule& s, const std::vector<StageSpec>& stages, const Plan& plan, const unsigned char* img, unsigned char* const* buffers, int width, int height, int channels) {
+    if (s.computeAtTile) return runFusedSchedule(exec, s, stages, img, buffers, width, height, channels);
+    return runRootSchedule(exec, s, plan, img, buffers, width, height, channels);
+}
+
+#endif // CST435_SCHEDULE_H
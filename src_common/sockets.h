@@ -0,0 +1,237 @@
+/**
+ * @file sockets.h
+ * @brief Line-based stream sockets over TCP and Unix domain sockets
+ * @course CST435: Parallel Computing
+ *
+ * The lease protocol (leasing.h) and the daemon protocol (daemon.h) are both
+ * newline-terminated text. On a Unix socket a line may also carry file
+ * descriptors (SCM_RIGHTS): sendLine(line, fd) attaches one to the line, and
+ * fill() queues every descriptor that arrives for takeFd() to hand out in
+ * order, so an image can change hands as a memfd without being copied
+ * through the socket.
+ */
+
+#ifndef CST435_SOCKETS_H
+#define CST435_SOCKETS_H
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <string>
+
+// ==========================================
+//                 LINE SOCKETS
+// ==========================================
+class LineSocket {
+public:
+    explicit LineSocket(int fd = -1) : fd_(fd) {}
+    LineSocket(const LineSocket&) = delete;
+    LineSocket& operator=(const LineSocket&) = delete;
+    ~LineSocket() {
+        close();
+        for (int fd : fds_) ::close(fd);
+    }
+
+    int fd() const { return fd_; }
+    bool isOpen() const { return fd_ >= 0; }
+    void close() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    // Connects to host:port; false (and 'error') on failure.
+    bool connectTo(const std::string& host, int port, std::string& error) {
+        addrinfo hints = {}, *found = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found);
+        if (rc != 0) {
+            error = "Cannot resolve '" + host + "': " + gai_strerror(rc);
+            return false;
+        }
+        for (addrinfo* a = found; a && fd_ < 0; a = a->ai_next) {
+            fd_ = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd_ >= 0 && ::connect(fd_, a->ai_addr, a->ai_addrlen) != 0) close();
+        }
+        freeaddrinfo(found);
+        if (fd_ < 0) {
+            error = "Cannot connect to " + host + ":" + std::to_string(port) + ": " + std::strerror(errno);
+            return false;
+        }
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return true;
+    }
+
+    // Connects to the Unix socket at 'path'; false (and 'error') on failure.
+    bool connectUnix(const std::string& path, std::string& error) {
+        sockaddr_un addr = {};
+        if (path.size() >= sizeof(addr.sun_path)) {
+            error = "Socket path too long: " + path;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ >= 0 && ::connect(fd_, (sockaddr*)&addr, sizeof(addr)) != 0) close();
+        if (fd_ < 0) {
+            error = "Cannot connect to " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // Sends one line; 'passFd' >= 0 travels with it (Unix sockets only).
+    bool sendLine(const std::string& line, int passFd = -1) {
+        std::string data = line + "\n";
+        size_t sent = 0;
+        if (passFd >= 0) {
+            iovec iov = { (void*)data.data(), data.size() };
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+            msghdr msg = {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(cmsg), &passFd, sizeof(int));
+            ssize_t n = sendmsg(fd_, &msg, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent = (size_t)n;
+        }
+        while (sent < data.size()) {
+            ssize_t n = send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += (size_t)n;
+        }
+        return true;
+    }
+
+    // Blocks until a whole line has arrived; false once the peer has gone.
+    bool readLine(std::string& line) {
+        while (!nextLine(line)) {
+            if (!fill()) return false;
+        }
+        return true;
+    }
+
+    // One recvmsg() into the buffer (call when poll() reports the socket readable).
+    bool fill() {
+        char chunk[4096];
+        iovec iov = { chunk, sizeof(chunk) };
+        alignas(cmsghdr) char control[CMSG_SPACE(4 * sizeof(int))];
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t n = recvmsg(fd_, &msg, MSG_CMSG_CLOEXEC);
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; ++i) {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                fds_.push_back(fd);
+            }
+        }
+        if (n <= 0) return false;
+        buffer_.append(chunk, (size_t)n);
+        return true;
+    }
+
+    // The oldest received descriptor not yet taken (the caller owns it), or -1.
+    int takeFd() {
+        if (fds_.empty()) return -1;
+        int fd = fds_.front();
+        fds_.pop_front();
+        return fd;
+    }
+
+    // A complete buffered line, without blocking.
+    bool nextLine(std::string& line) {
+        size_t end = buffer_.find('\n');
+        if (end == std::string::npos) return false;
+        line = buffer_.substr(0, end);
+        buffer_.erase(0, end + 1);
+        return true;
+    }
+
+private:
+    int fd_;
+    std::string buffer_;
+    std::deque<int> fds_;              // descriptors received, not yet taken
+};
+
+// Listening socket on 'port' (0 = any free port); returns the fd, or -1 and 'error'.
+inline int listenOn(int& port, std::string& error) {
+    int fd = socket(AF_INET6, SOCK_STREAM, 0);
+    bool v6 = fd >= 0;
+    if (!v6) fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1, zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    int rc;
+    if (v6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));   // accept IPv4 as well
+        sockaddr_in6 addr = {};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons((uint16_t)port);
+        rc = bind(fd, (sockaddr*)&addr, sizeof(addr));
+    } else {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons((uint16_t)port);
+        rc = bind(fd, (sockaddr*)&addr, sizeof(addr));
+    }
+    if (fd < 0 || rc != 0 || ::listen(fd, 64) != 0) {
+        error = "Cannot listen on port " + std::to_string(port) + ": " + std::strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+    sockaddr_storage bound = {};
+    socklen_t length = sizeof(bound);
+    getsockname(fd, (sockaddr*)&bound, &length);
+    port = ntohs(bound.ss_family == AF_INET6 ? ((sockaddr_in6*)&bound)->sin6_port : ((sockaddr_in*)&bound)->sin_port);
+    return fd;
+}
+
+// Listening Unix socket at 'path', replacing a stale socket file; returns the fd, or -1 and 'error'.
+inline int listenUnix(const std::string& path, std::string& error) {
+    sockaddr_un addr = {};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        error = "Socket path too long: " + path;
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // A socket file nobody accepts on is left over from a daemon that did not exit cleanly
+    if (fd >= 0 && ::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+        error = "A daemon is already listening on " + path;
+        ::close(fd);
+        return -1;
+    }
+    if (fd >= 0) ::close(fd);
+    unlink(path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(fd, 64) != 0) {
+        error = "Cannot listen on " + path + ": " + std::strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+#endif // CST435_SOCKETS_H
@@ -0,0 +1,510 @@
+/**
+ * @file stream.h
+ * @brief Images from stdin, results to stdout, for shell pipelines (--stream)
+ * @course CST435: Parallel Computing
+ *
+ * With --stream the processor reads encoded images from stdin and writes the
+ * results (JPEG, as --save would) to stdout in the same framing, so tools can
+ * be chained without staging files on disk:
+ *   --stream / --stream=frames   every image is a 4-byte big-endian length and
+ *                                that many bytes; a failed image is answered
+ *                                with an empty frame, so results line up with
+ *                                the input
+ *   --stream=tar                 a tar archive in, a tar archive out: image
+ *                                members become NAME_output.jpg, and every
+ *                                other member (directories, manifests) is
+ *                                copied through unchanged; failed images are
+ *                                left out
+ * Three stages overlap: a reader thread frames the input ahead of the batch
+ * loop (up to kStreamAhead images), the batch loop decodes and runs the
+ * pipeline, and a writer thread encodes the results and writes them in input
+ * order. Input and output go through kStreamBufferBytes buffers (and pipes
+ * are enlarged to that size), and members copied through a tar stream go
+ * from stdin to stdout with splice() when both are pipes, without passing
+ * through user space. Report lines go to stderr.
+ */
+
+#ifndef CST435_STREAM_H
+#define CST435_STREAM_H
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/stb_image.h"
+#include "../include/stb_image_write.h"
+#include "admission.h"
+
+const size_t kStreamBufferBytes = 1 << 20;
+const size_t kStreamAhead = 4;         // images framed ahead, and results waiting to be written
+const size_t kTarBlock = 512;
+
+inline bool isPipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+// Lets a pipe hold kStreamBufferBytes, so each read and write moves that much at a time.
+inline void enlargePipe(int fd) {
+    if (isPipe(fd)) fcntl(fd, F_SETPIPE_SZ, (int)kStreamBufferBytes);
+}
+
+// ==========================================
+//              BUFFERED STREAM I/O
+// ==========================================
+class StreamReader {
+public:
+    explicit StreamReader(int fd) : fd_(fd), buffer_(kStreamBufferBytes) {}
+
+    // Reads exactly 'n' bytes; false if the input ends first ('got' = how many arrived).
+    bool read(unsigned char* out, size_t n, size_t* got = nullptr) {
+        size_t done = 0;
+        while (done < n) {
+            if (pos_ == end_ && !fill()) {
+                if (got) *got = done;
+                return false;
+            }
+            size_t k = std::min(n - done, end_ - pos_);
+            std::memcpy(out + done, buffer_.data() + pos_, k);
+            pos_ += k;
+            done += k;
+        }
+        if (got) *got = done;
+        return true;
+    }
+
+    // Moves up to 'n' bytes that are already buffered to the end of 'out', without reading.
+    size_t takeBuffered(size_t n, std::vector<unsigned char>& out) {
+        size_t k = std::min(n, end_ - pos_);
+        out.insert(out.end(), buffer_.data() + pos_, buffer_.data() + pos_ + k);
+        pos_ += k;
+        return k;
+    }
+
+    int fd() const { return fd_; }
+    size_t bytesRead() const { return total_; }
+
+private:
+    bool fill() {
+        ssize_t n;
+        do n = ::read(fd_, buffer_.data(), buffer_.size()); while (n < 0 && errno == EINTR);
+        if (n <= 0) return false;
+        pos_ = 0;
+        end_ = (size_t)n;
+        total_ += (size_t)n;
+        return true;
+    }
+
+    int fd_;
+    std::vector<unsigned char> buffer_;
+    size_t pos_ = 0, end_ = 0;
+    size_t total_ = 0;
+};
+
+class StreamWriter {
+public:
+    explicit StreamWriter(int fd) : fd_(fd) { buffer_.reserve(kStreamBufferBytes); }
+
+    bool write(const void* data, size_t n) {
+        if (buffer_.size() + n > kStreamBufferBytes && !flush()) return false;
+        if (n >= kStreamBufferBytes) return writeAll((const unsigned char*)data, n);
+        buffer_.insert(buffer_.end(), (const unsigned char*)data, (const unsigned char*)data + n);
+        return true;
+    }
+
+    bool flush() {
+        bool ok = writeAll(buffer_.data(), buffer_.size());
+        buffer_.clear();
+        return ok;
+    }
+
+    // Copies the next 'n' bytes of 'in' to the output: with splice() when both are pipes,
+    // otherwise through a buffer.
+    bool copyFrom(int in, size_t n) {
+        if (!flush()) return false;
+        bool pipes = isPipe(in) && isPipe(fd_);
+        while (n > 0 && pipes) {
+            ssize_t k = splice(in, nullptr, fd_, nullptr, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (k < 0 && errno == EINTR) continue;
+            if (k == 0) return false;
+            if (k < 0) break;          // not spliceable after all: copy the rest
+            n -= (size_t)k;
+            spliced_ += (size_t)k;
+            copied_ += (size_t)k;
+            total_ += (size_t)k;
+        }
+        std::vector<unsigned char> chunk(std::min(n, kStreamBufferBytes));
+        while (n > 0) {
+            ssize_t k = ::read(in, chunk.data(), std::min(n, chunk.size()));
+            if (k < 0 && errno == EINTR) continue;
+            if (k <= 0 || !writeAll(chunk.data(), (size_t)k)) return false;
+            n -= (size_t)k;
+            copied_ += (size_t)k;
+        }
+        return true;
+    }
+
+    size_t bytesWritten() const { return total_; }
+    size_t bytesCopied() const { return copied_; }
+    size_t bytesSpliced() const { return spliced_; }
+
+private:
+    bool writeAll(const unsigned char* data, size_t n) {
+        while (n > 0) {
+            ssize_t k = ::write(fd_, data, n);
+            if (k < 0 && errno == EINTR) continue;
+            if (k <= 0) return false;
+            data += k;
+            n -= (size_t)k;
+            total_ += (size_t)k;
+        }
+        return true;
+    }
+
+    int fd_;
+    std::vector<unsigned char> buffer_;
+    size_t total_ = 0, copied_ = 0, spliced_ = 0;
+};
+
+// ==========================================
+//                TAR HEADERS
+// ==========================================
+// Size field: octal, or GNU base-256 when the top bit of the first byte is set.
+inline size_t tarSize(const unsigned char* field) {
+    size_t size = 0;
+    if (field[0] & 0x80) {
+        for (int i = 1; i < 12; ++i) size = (size << 8) | field[i];
+        return size;
+    }
+    for (int i = 0; i < 12 && field[i] >= '0' && field[i] <= '7'; ++i) size = size * 8 + (field[i] - '0');
+    return size;
+}
+
+inline std::string tarField(const unsigned char* field, size_t length) {
+    return std::string((const char*)field, strnlen((const char*)field, length));
+}
+
+// The member's path: ustar keeps long paths as prefix + "/" + name.
+inline std::string tarName(const unsigned char* header) {
+    std::string name = tarField(header, 100);
+    std::string prefix = std::memcmp(header + 257, "ustar", 5) == 0 ? tarField(header + 345, 155) : "";
+    return prefix.empty() ? name : prefix + "/" + name;
+}
+
+// "path" from the records ("LENGTH key=value\n") of a pax extended header, or "".
+inline std::string paxPath(const std::vector<unsigned char>& records) {
+    std::string text(records.begin(), records.end());
+    for (size_t pos = 0; pos < text.size();) {
+        size_t space = text.find(' ', pos);
+        size_t length = std::strtoul(text.c_str() + pos, nullptr, 10);
+        if (space == std::string::npos || length == 0) break;
+        std::string record = text.substr(space + 1, pos + length - space - 2);
+        if (record.compare(0, 5, "path=") == 0) return record.substr(5);
+        pos += length;
+    }
+    return "";
+}
+
+// Header block(s) of a regular file; names over 100 bytes get a GNU long-name member first.
+inline std::vector<unsigned char> tarHeader(const std::string& name, size_t size, char type = '0') {
+    std::vector<unsigned char> blocks;
+    if (name.size() > 100) {
+        blocks = tarHeader("././@LongLink", name.size() + 1, 'L');
+        blocks.insert(blocks.end(), name.begin(), name.end());
+        blocks.resize(blocks.size() + (kTarBlock - name.size() % kTarBlock), 0);
+    }
+    unsigned char h[kTarBlock] = {};
+    std::memcpy(h, name.c_str(), std::min<size_t>(name.size(), 100));
+    std::snprintf((char*)h + 100, 8, "%07o", 0644);
+    std::snprintf((char*)h + 108, 8, "%07o", 0);
+    std::snprintf((char*)h + 116, 8, "%07o", 0);
+    std::snprintf((char*)h + 124, 12, "%011llo", (unsigned long long)size);
+    std::snprintf((char*)h + 136, 12, "%011llo", (unsigned long long)std::time(nullptr));
+    h[156] = (unsigned char)type;
+    std::memcpy(h + 257, "ustar", 6);
+    std::memcpy(h + 263, "00", 2);
+    std::memset(h + 148, ' ', 8);
+    unsigned sum = 0;
+    for (unsigned char b : h) sum += b;
+    std::snprintf((char*)h + 148, 8, "%06o", sum);
+    blocks.insert(blocks.end(), h, h + kTarBlock);
+    return blocks;
+}
+
+// ==========================================
+//                STREAM SOURCE
+// ==========================================
+class StreamSource : public WorkSource {
+public:
+    explicit StreamSource(bool tar) : tar_(tar), in_(STDIN_FILENO), out_(STDOUT_FILENO) {}
+
+    ~StreamSource() override { close(); }
+
+    void start() {
+        enlargePipe(STDIN_FILENO);
+        enlargePipe(STDOUT_FILENO);
+        reader_ = std::thread([this] {
+            if (tar_) readTar();
+            else readFrames();
+            std::lock_guard<std::mutex> lock(mutex_);
+            readerDone_ = true;
+            changed_.notify_all();
+        });
+        writer_ = std::thread([this] { writeLoop(); });
+    }
+
+    // Waits until every result is written; false if the input or the output was cut short.
+    bool close() {
+        if (reader_.joinable()) reader_.join();
+        if (writer_.joinable()) writer_.join();
+        return ok_;
+    }
+
+    int index() const override { return 0; }
+    std::string tag() const override { return ""; }
+    bool standalone() const override { return true; }
+    bool takesResults() const override { return true; }
+
+    bool claim(ImageInfo& info) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (inputs_.empty() && !readerDone_) {
+            if (held_ > 0) return false;   // let the batch loop run what it holds first
+            changed_.wait(lock);
+        }
+        if (inputs_.empty()) return false;
+        info = inputs_.front();
+        inputs_.pop_front();
+        held_++;
+        changed_.notify_all();
+        return true;
+    }
+
+    void finish(const ImageInfo& info, int32_t state) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        held_--;
+        if (state != kItemDone) {
+            Output& o = outputs_[info.id];
+            o.kind = Output::Failed;
+            o.name = info.filename;
+        }
+        changed_.notify_all();
+    }
+
+    void recordBusy(double) override {}
+
+    // Copies the result (the frame buffers are reused) for the writer thread to encode.
+    void putResult(const ImageInfo& info, const unsigned char* pixels) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&] { return pendingResults_ < kStreamAhead; });
+        Output& o = outputs_[info.id];
+        o.kind = Output::Result;
+        o.name = info.filename;
+        o.width = info.width; o.height = info.height; o.channels = info.channels;
+        o.bytes.assign(pixels, pixels + info.bytes);
+        pendingResults_++;
+        changed_.notify_all();
+    }
+
+    int imagesIn() const { return imagesIn_; }
+    int resultsOut() const { return resultsOut_; }
+    int copiedThrough() const { return copiedThrough_; }
+    size_t bytesRead() const { return in_.bytesRead() + out_.bytesCopied(); }
+    size_t bytesWritten() const { return out_.bytesWritten(); }
+    size_t bytesSpliced() const { return out_.bytesSpliced(); }
+
+private:
+    // What the writer emits for one input item, in input order
+    struct Output {
+        enum Kind { Result, Failed, CopyThrough } kind = Failed;
+        std::string name;
+        int width = 0, height = 0, channels = 0;
+        std::vector<unsigned char> bytes;   // result pixels, or the start of a copied member
+        size_t remaining = 0;               // copied member: bytes still to come from stdin
+    };
+
+    void fail(const std::string& message) {
+        std::cerr << "Error: " << message << std::endl;
+        std::lock_guard<std::mutex> lock(mutex_);
+        ok_ = false;
+    }
+
+    // Queues an image for the batch loop once fewer than kStreamAhead are waiting.
+    void pushImage(const std::string& name, std::shared_ptr<std::vector<unsigned char>> data) {
+        ImageInfo info;
+        info.filename = name;
+        info.path = name;
+        info.readable = !data->empty() && stbi_info_from_memory(data->data(), (int)data->size(), &info.width, &info.height, &info.channels);
+        if (info.readable) info.bytes = (size_t)info.width * info.height * info.channels;
+        info.encoded = data;
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&] { return inputs_.size() < kStreamAhead; });
+        info.id = nextItem_++;
+        inputs_.push_back(info);
+        imagesIn_++;
+        changed_.notify_all();
+    }
+
+    // Queues a member to copy through unchanged; the part not yet buffered is read from
+    // stdin by the writer, so the reader waits until the writer has taken it.
+    void pushCopyThrough(std::vector<unsigned char> start, size_t remaining) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        int item = nextItem_++;
+        Output& o = outputs_[item];
+        o.kind = Output::CopyThrough;
+        o.bytes = std::move(start);
+        o.remaining = remaining;
+        copiedThrough_++;
+        changed_.notify_all();
+        if (remaining > 0) changed_.wait(lock, [&] { return written_ > item; });
+    }
+
+    void readFrames() {
+        unsigned char length[4];
+        size_t got;
+        for (int frame = 0; ; ++frame) {
+            if (!in_.read(length, 4, &got)) {
+                if (got) fail("stream ended inside the length of frame " + std::to_string(frame));
+                return;
+            }
+            size_t size = ((size_t)length[0] << 24) | ((size_t)length[1] << 16) | ((size_t)length[2] << 8) | length[3];
+            auto data = std::make_shared<std::vector<unsigned char>>(size);
+            if (!in_.read(data->data(), size)) {
+                fail("stream ended inside frame " + std::to_string(frame));
+                return;
+            }
+            pushImage("frame" + std::to_string(frame), data);
+        }
+    }
+
+    void readTar() {
+        unsigned char header[kTarBlock];
+        size_t got;
+        std::vector<unsigned char> meta;   // long-name / pax headers of the next member
+        std::string longName;
+        while (in_.read(header, kTarBlock, &got)) {
+            if (std::all_of(header, header + kTarBlock, [](unsigned char b) { return b == 0; })) return;   // end of archive
+            size_t size = tarSize(header + 124);
+            size_t padded = (size + kTarBlock - 1) / kTarBlock * kTarBlock;
+            char type = (char)header[156];
+            std::string name = longName.empty() ? tarName(header) : longName;
+
+            if (type == 'L' || type == 'K' || type == 'x') {
+                std::vector<unsigned char> data(padded);
+                if (!in_.read(data.data(), padded)) break;
+                meta.insert(meta.end(), header, header + kTarBlock);
+                meta.insert(meta.end(), data.begin(), data.end());
+                data.resize(size);
+                if (type == 'L') longName = tarField(data.data(), size);
+                if (type == 'x' && !paxPath(data).empty()) longName = paxPath(data);
+                continue;
+            }
+            longName.clear();
+
+            if ((type == '0' || type == '\0') && isImageFile(name)) {
+                auto data = std::make_shared<std::vector<unsigned char>>(padded);
+                if (!in_.read(data->data(), padded)) break;
+                data->resize(size);
+                meta.clear();
+                pushImage(name, data);
+                continue;
+            }
+            std::vector<unsigned char> start = std::move(meta);
+            meta.clear();
+            start.insert(start.end(), header, header + kTarBlock);
+            size_t taken = in_.takeBuffered(padded, start);
+            pushCopyThrough(std::move(start), padded - taken);
+        }
+        if (got == 0) return;              // no end-of-archive blocks, but nothing cut short
+        fail("tar stream ended inside a member");
+    }
+
+    static void appendBytes(void* context, void* data, int size) {
+        std::vector<unsigned char>& out = *(std::vector<unsigned char>*)context;
+        out.insert(out.end(), (unsigned char*)data, (unsigned char*)data + size);
+    }
+
+    // Writes one item; false if stdout or stdin failed.
+    bool emit(const Output& o) {
+        if (o.kind == Output::CopyThrough) return out_.write(o.bytes.data(), o.bytes.size()) && out_.copyFrom(in_.fd(), o.remaining);
+
+        std::vector<unsigned char> jpeg;
+        if (o.kind == Output::Result && !stbi_write_jpg_to_func(appendBytes, &jpeg, o.width, o.height, o.channels, o.bytes.data(), 100)) {
+            std::cerr << "Error: Could not encode the result of " << o.name << std::endl;
+        }
+        if (!tar_) {
+            unsigned char length[4] = { (unsigned char)(jpeg.size() >> 24), (unsigned char)(jpeg.size() >> 16),
+                                        (unsigned char)(jpeg.size() >> 8), (unsigned char)jpeg.size() };
+            return out_.write(length, 4) && out_.write(jpeg.data(), jpeg.size());
+        }
+        if (jpeg.empty()) return true;
+        std::string baseName = o.name.substr(0, o.name.find_last_of("."));
+        std::vector<unsigned char> header = tarHeader(baseName + "_output.jpg", jpeg.size());
+        static const unsigned char padding[kTarBlock] = {};
+        return out_.write(header.data(), header.size()) && out_.write(jpeg.data(), jpeg.size())
+            && out_.write(padding, (kTarBlock - jpeg.size() % kTarBlock) % kTarBlock);
+    }
+
+    void writeLoop() {
+        bool ok = true;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            changed_.wait(lock, [&] { return outputs_.count(written_) || (readerDone_ && written_ == nextItem_); });
+            if (!outputs_.count(written_)) break;
+            Output o = std::move(outputs_[written_]);
+            outputs_.erase(written_);
+            bool more = outputs_.count(written_ + 1) > 0;
+            lock.unlock();
+            if (ok) {
+                ok = emit(o);
+                if (ok && !more) ok = out_.flush();   // nothing else ready: do not hold results back
+            }
+            lock.lock();
+            if (o.kind == Output::Result) {
+                pendingResults_--;
+                resultsOut_++;
+            }
+            written_++;
+            changed_.notify_all();
+        }
+        lock.unlock();
+        if (ok && tar_) {
+            static const unsigned char end[2 * kTarBlock] = {};
+            ok = out_.write(end, sizeof(end));
+        }
+        if (ok) ok = out_.flush();
+        if (!ok) fail("could not write the output stream");
+    }
+
+    bool tar_;
+    StreamReader in_;
+    StreamWriter out_;
+    std::thread reader_, writer_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<ImageInfo> inputs_;         // framed, waiting for the batch loop
+    std::map<int, Output> outputs_;        // by input position, waiting for the writer
+    int nextItem_ = 0;                     // input position of the next item read
+    int written_ = 0;                      // items written so far
+    size_t pendingResults_ = 0;
+    int held_ = 0;                         // claimed by the batch loop, not yet finished
+    bool readerDone_ = false;
+    bool ok_ = true;
+    int imagesIn_ = 0, resultsOut_ = 0, copiedThrough_ = 0;
+};
+
+#endif // CST435_STREAM_H
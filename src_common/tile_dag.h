@@ -0,0 +1,159 @@
+/**
+ * @file tile_dag.h
+ * @brief Barrier-free execution of a plan as a DAG of row tiles
+ * @course CST435: Parallel Computing
+ *
+ * executePlan() ends every step with a barrier: no worker may start the next
+ * stage until the slowest row range of the current one is done. Here each step
+ * is cut into tiles of 'tileRows' rows and every (step, tile) is a task that
+ * only waits for the tasks it really conflicts with:
+ *   - read-after-write : earlier tiles that produced rows we read (tile +/- 1 for a 3x3 halo)
+ *   - write-after-read : earlier tiles that still read rows we are about to overwrite
+ *                        (ping-pong buffers are reused every second step)
+ *   - write-after-write: the same tile of an earlier step writing the same buffer
+ * With wrap borders the first and last tiles of a stencil read each other's
+ * rows, so they are treated as neighbours as well.
+ * Each task has an atomic counter of unfinished dependencies; the worker that
+ * drops it to zero publishes the task to a shared ready list. Workers therefore
+ * run sharpen on the top tiles while blur is still busy further down the image.
+ */
+
+#ifndef CST435_TILE_DAG_H
+#define CST435_TILE_DAG_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "executor.h"
+#include "pipeline.h"
+
+const int kDefaultDagTileRows = 64;
+
+struct TileGraph {
+    int tiles = 0;                           // tiles per step
+    int tileRows = 0;
+    std::vector<std::vector<int>> successors; // task id = step * tiles + tile
+    std::vector<int> dependencyCount;
+};
+
+// Rows [first, last] touched by one tile of a step, widened by 'halo' and clipped.
+inline void tileRowSpan(int tile, int tileRows, int halo, int height, int& first, int& last) {
+    first = std::max(0, tile * tileRows - halo);
+    last = std::min(height - 1, (tile + 1) * tileRows - 1 + halo);
+}
+
+inline bool spansOverlap(int a0, int a1, int b0, int b1) { return a0 <= b1 && b0 <= a1; }
+
+// True if a stencil of the step reads across the top/bottom edge into the other end of the image.
+inline bool stepWrapsRows(const PlanStep& step) {
+    for (const StageSpec& stage : step.stages) {
+        if (!isPointStage(stage.kind) && stage.border.mode == BorderMode::Wrap) return true;
+    }
+    return false;
+}
+
+inline TileGraph buildTileGraph(const Plan& plan, int height, int tileRows) {
+    TileGraph g;
+    g.tileRows = tileRows;
+    g.tiles = (height + tileRows - 1) / tileRows;
+    int steps = (int)plan.steps.size();
+    g.successors.assign(steps * g.tiles, {});
+    g.dependencyCount.assign(steps * g.tiles, 0);
+
+    for (int k = 0; k < steps; ++k) {
+        const PlanStep& sk = plan.steps[k];
+        int haloK = sk.stencil ? 1 : 0;
+        for (int t = 0; t < g.tiles; ++t) {
+            int readFirst, readLast, writeFirst, writeLast;
+            tileRowSpan(t, tileRows, haloK, height, readFirst, readLast);
+            tileRowSpan(t, tileRows, 0, height, writeFirst, writeLast);
+
+            for (int j = 0; j < k; ++j) {
+                const PlanStep& sj = plan.steps[j];
+                int haloJ = sj.stencil ? 1 : 0;
+                // Only tiles near t can overlap (halo is at most one row), plus the
+                // tile at the other end of the image when a stencil wraps around
+                std::vector<int> near;
+                for (int u = std::max(0, t - 1); u <= std::min(g.tiles - 1, t + 1); ++u) near.push_back(u);
+                int across = t == 0 ? g.tiles - 1 : t == g.tiles - 1 ? 0 : -1;
+                bool wrapPair = across >= 0 && std::abs(across - t) > 1 && (stepWrapsRows(sk) || stepWrapsRows(sj));
+                if (wrapPair) near.push_back(across);
+
+                for (int u : near) {
+                    int jReadFirst, jReadLast, jWriteFirst, jWriteLast;
+                    tileRowSpan(u, tileRows, haloJ, height, jReadFirst, jReadLast);
+                    tileRowSpan(u, tileRows, 0, height, jWriteFirst, jWriteLast);
+
+                    bool wrapped = wrapPair && u == across;
+                    bool raw = sj.dst == sk.src && (wrapped ? stepWrapsRows(sk) : spansOverlap(jWriteFirst, jWriteLast, readFirst, readLast));
+                    bool war = sj.src == sk.dst && (wrapped ? stepWrapsRows(sj) : spansOverlap(jReadFirst, jReadLast, writeFirst, writeLast));
+                    bool waw = sj.dst == sk.dst && u == t;
+                    if (raw || war || waw) {
+                        g.successors[j * g.tiles + u].push_back(k * g.tiles + t);
+                        g.dependencyCount[k * g.tiles + t]++;
+                    }
+                }
+            }
+        }
+    }
+    return g;
+}
+
+// Runs every task of the graph on the executor's workers without stage barriers.
+inline void executeTileGraph(Executor& exec, const TileGraph& g, const Plan& plan, const unsigned char* img, unsigned char* const* buffers, int width, int height, int channels) {
+    int total = (int)g.dependencyCount.size();
+    std::unique_ptr<std::atomic<int>[]> remaining(new std::atomic<int>[total]);
+    // Ready list: slot i holds the i-th task to become ready (-1 until published)
+    std::unique_ptr<std::atomic<int>[]> ready(new std::atomic<int>[total]);
+    std::atomic<int> published{0}, claimed{0};
+
+    for (int id = 0; id < total; ++id) {
+        remaining[id].store(g.dependencyCount[id], std::memory_order_relaxed);
+        ready[id].store(-1, std::memory_order_relaxed);
+    }
+    for (int id = 0; id < total; ++id) {
+        if (g.dependencyCount[id] == 0) ready[published++].store(id, std::memory_order_relaxed);
+    }
+
+    auto resolve = [&](int b) { return b == kSourceImage ? img : buffers[b]; };
+
+    auto runTask = [&](int id) {
+        const PlanStep& step = plan.steps[id / g.tiles];
+        int s = (id % g.tiles) * g.tileRows;
+        int e = std::min(height, s + g.tileRows);
+        const unsigned char* in = resolve(step.src);
+        unsigned char* out = buffers[step.dst];
+        runStageRows(step.stages[0], in, out, width, height, channels, s, e);
+        for (size_t k = 1; k < step.stages.size(); ++k) {
+            runStageRows(step.stages[k], out, out, width, height, channels, s, e);
+        }
+    };
+
+    // One long-running loop per worker: claim the next ready slot, wait for it to be
+    // published, run it, then release its successors.
+    exec.parallelFor(exec.threads(), [&](int begin, int end) {
+        (void)begin; (void)end;
+        for (;;) {
+            int slot = claimed.fetch_add(1, std::memory_order_relaxed);
+            if (slot >= total) return;
+
+            int id;
+            while ((id = ready[slot].load(std::memory_order_acquire)) < 0) std::this_thread::yield();
+
+            runTask(id);
+
+            for (int next : g.successors[id]) {
+                if (remaining[next].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    int pos = published.fetch_add(1, std::memory_order_relaxed);
+                    ready[pos].store(next, std::memory_order_release);
+                }
+            }
+        }
+    });
+}
+
+#endif // CST435_TILE_DAG_H
@@ -0,0 +1,199 @@
+/**
+ * @file topology.h
+ * @brief CPU topology discovery, worker pinning and NUMA first-touch placement
+ * @course CST435: Parallel Computing
+ *
+ * Without pinning the OS moves workers between CPUs, and frames allocated by
+ * the main thread end up on the main thread's NUMA node, so on multi-socket
+ * hosts the other socket's workers stream every row over the interconnect.
+ *
+ * The topology (package, NUMA node, core and SMT sibling of every CPU this
+ * process may use) is read from /sys. --affinity=MODE then pins worker i to
+ * the i-th CPU of one of these orders:
+ *   compact : fill a core's SMT siblings, then the next core, then the next node
+ *   scatter : spread across nodes first, then cores, SMT siblings last
+ *   nosmt   : one CPU per physical core (compact order), siblings only if needed
+ * On hosts with more than one node, frame rows are first touched by the
+ * worker that will compute them, so their pages land on that worker's node.
+ */
+
+#ifndef CST435_TOPOLOGY_H
+#define CST435_TOPOLOGY_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "executor.h"
+#include "pipeline.h"
+
+// ==========================================
+//              TOPOLOGY DISCOVERY
+// ==========================================
+struct LogicalCpu {
+    int id = 0;
+    int package = 0;
+    int node = 0;
+    int core = 0;          // core_id (unique within a package)
+    int smt = 0;           // index among the core's hardware threads
+};
+
+struct Topology {
+    std::vector<LogicalCpu> cpus;     // usable by this process, ordered by id
+    int packages = 0, nodes = 0, cores = 0;
+};
+
+// Parses a kernel CPU list such as "0-3,8,10-11".
+inline std::vector<int> parseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    std::istringstream items(text);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        item = trim(item);
+        if (item.empty()) continue;
+        size_t dash = item.find('-');
+        int first = std::atoi(item.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(item.c_str() + dash + 1);
+        for (int c = first; c <= last; ++c) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+inline Topology discoverTopology() {
+    Topology topo;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    // Kernels without NUMA support have no node directories: everything is node 0
+    std::map<int, int> nodeOf;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() < 5 || name.compare(0, 4, "node") != 0 || !std::isdigit((unsigned char)name[4])) continue;
+        int node = std::atoi(name.c_str() + 4);
+        for (int cpu : parseCpuList(readFirstLine(entry.path().string() + "/cpulist"))) nodeOf[cpu] = node;
+    }
+
+    for (int id : parseCpuList(readFirstLine("/sys/devices/system/cpu/online"))) {
+        if (haveMask && !CPU_ISSET(id, &allowed)) continue;
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+        LogicalCpu cpu;
+        cpu.id = id;
+        cpu.package = std::atoi(readFirstLine(dir + "physical_package_id").c_str());
+        cpu.core = std::atoi(readFirstLine(dir + "core_id").c_str());
+        cpu.node = nodeOf.count(id) ? nodeOf[id] : 0;
+        std::vector<int> siblings = parseCpuList(readFirstLine(dir + "thread_siblings_list"));
+        cpu.smt = (int)(std::find(siblings.begin(), siblings.end(), id) - siblings.begin());
+        if (cpu.smt == (int)siblings.size()) cpu.smt = 0;
+        topo.cpus.push_back(cpu);
+    }
+
+    std::set<int> packages, nodes;
+    std::set<std::pair<int, int>> cores;
+    for (const LogicalCpu& c : topo.cpus) {
+        packages.insert(c.package);
+        nodes.insert(c.node);
+        cores.insert({c.package, c.core});
+    }
+    topo.packages = (int)packages.size();
+    topo.nodes = (int)nodes.size();
+    topo.cores = (int)cores.size();
+    return topo;
+}
+
+inline std::string describeTopology(const Topology& t) {
+    std::ostringstream out;
+    out << t.packages << " package(s), " << t.nodes << " NUMA node(s), " << t.cores << " core(s), " << t.cpus.size() << " CPU(s)";
+    return out.str();
+}
+
+// ==========================================
+//               WORKER PLACEMENT
+// ==========================================
+inline bool isPlacementName(const std::string& name) {
+    return name == "none" || name == "compact" || name == "scatter" || name == "nosmt";
+}
+
+// CPU for each of 'workers' workers (wrapping around if there are more workers than CPUs).
+inline std::vector<LogicalCpu> placeWorkers(const Topology& topo, const std::string& mode, int workers) {
+    std::vector<LogicalCpu> order = topo.cpus;
+    auto compactKey = [](const LogicalCpu& c) { return std::make_tuple(c.node, c.package, c.core, c.smt); };
+    std::sort(order.begin(), order.end(), [&](const LogicalCpu& a, const LogicalCpu& b) { return compactKey(a) < compactKey(b); });
+
+    if (mode == "nosmt") {
+        // Primary threads first, SMT siblings only once every core has a worker
+        std::stable_sort(order.begin(), order.end(), [](const LogicalCpu& a, const LogicalCpu& b) { return (a.smt > 0) < (b.smt > 0); });
+    } else if (mode == "scatter") {
+        // Rank each CPU's core within its node, then deal round-robin over the nodes
+        std::map<std::tuple<int, int, int>, int> coreRank;
+        std::map<int, int> coresInNode;
+        for (const LogicalCpu& c : order) {
+            auto key = std::make_tuple(c.node, c.package, c.core);
+            if (!coreRank.count(key)) coreRank[key] = coresInNode[c.node]++;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](const LogicalCpu& a, const LogicalCpu& b) {
+            auto ka = std::make_tuple(a.smt, coreRank[std::make_tuple(a.node, a.package, a.core)], a.node);
+            auto kb = std::make_tuple(b.smt, coreRank[std::make_tuple(b.node, b.package, b.core)], b.node);
+            return ka < kb;
+        });
+    }
+
+    std::vector<LogicalCpu> placement;
+    for (int i = 0; i < workers && !order.empty(); ++i) placement.push_back(order[i % order.size()]);
+    return placement;
+}
+
+// Pins every worker of 'exec' to its CPU. Returns the number of workers pinned.
+inline int pinWorkers(Executor& exec, const std::vector<LogicalCpu>& placement) {
+    std::atomic<int> pinned{0};
+    exec.forEachWorker([&](int id) {
+        if (id >= (int)placement.size()) return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(placement[id].id, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) pinned++;
+    });
+    return pinned.load();
+}
+
+inline std::string describePlacement(const std::vector<LogicalCpu>& placement) {
+    std::ostringstream out;
+    for (size_t i = 0; i < placement.size(); ++i) {
+        const LogicalCpu& c = placement[i];
+        out << (i ? ", " : "") << "w" << i << "->cpu" << c.id << " (node " << c.node << ", core " << c.core << (c.smt ? ", smt " + std::to_string(c.smt) : std::string()) << ")";
+    }
+    return out.str();
+}
+
+// ==========================================
+//             NUMA FIRST TOUCH
+// ==========================================
+// Drops the pages behind the first 'height' rows of 'frame' and faults them in again
+// from the workers that own those rows under the same split the pipeline uses, so
+// each page is placed on the node of the worker that computes it.
+inline void firstTouchRows(Executor& exec, unsigned char* frame, size_t rowBytes, int height, int grain) {
+    // Only whole pages inside the frame are dropped
+    uintptr_t begin = ((uintptr_t)frame + kPageBytes - 1) & ~(uintptr_t)(kPageBytes - 1);
+    uintptr_t end = ((uintptr_t)frame + rowBytes * height) & ~(uintptr_t)(kPageBytes - 1);
+    if (end > begin) madvise((void*)begin, end - begin, MADV_DONTNEED);
+    exec.parallelFor(height, [&](int s, int e) {
+        std::memset(frame + (size_t)s * rowBytes, 0, (size_t)(e - s) * rowBytes);
+    }, grain);
+}
+
+#endif // CST435_TOPOLOGY_H
@@ -0,0 +1,185 @@
+/**
+ * @file watch.h
+ * @brief Continuous ingestion of a watched input folder with inotify (--watch)
+ * @course CST435: Parallel Computing
+ *
+ * Without --watch the batch loop scans the input folder once and exits, so
+ * an upload pipeline has to relaunch it and everything is scanned again.
+ * With --watch the same batch loop keeps its workers, frame buffers and
+ * decoder arena and takes its images from a WatchSource:
+ *   - first the files already in the folder (the backlog); the watch is set
+ *     up before the scan, so nothing written meanwhile is missed
+ *   - then every file that arrives, from IN_CLOSE_WRITE (written in place)
+ *     and IN_MOVED_TO (renamed in) events, without rescanning the folder
+ * A file is only handed out once it has settled: its writer has closed it
+ * (or it was renamed in) and no IN_MODIFY has followed for --settle-ms
+ * milliseconds. A writer that reopens the file restarts the wait, and a file
+ * deleted or moved away while it settles is forgotten. Backlog files changed
+ * within the settle time are treated as still arriving.
+ * claim() blocks for new files only while the batch loop holds none (so a
+ * partly filled --batch group still runs), until SIGINT or SIGTERM.
+ */
+
+#ifndef CST435_WATCH_H
+#define CST435_WATCH_H
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "admission.h"
+
+const int kDefaultSettleMillis = 200;
+
+// Set from SIGINT/SIGTERM; the watch stops once the images in flight are done.
+inline volatile sig_atomic_t& watchStopRequested() {
+    static volatile sig_atomic_t stop = 0;
+    return stop;
+}
+
+class WatchSource : public WorkSource {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    WatchSource(const std::string& folder, int settleMillis)
+        : folder_(folder), settle_(std::chrono::milliseconds(std::max(0, settleMillis))) {}
+
+    ~WatchSource() override {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    // Starts watching and scans the backlog; false (and 'error') if the folder cannot be watched.
+    bool start(std::string& error) {
+        namespace fs = std::filesystem;
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0 || inotify_add_watch(fd_, folder_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_DELETE | IN_MOVED_FROM) < 0) {
+            error = "Cannot watch '" + folder_ + "': " + std::strerror(errno);
+            return false;
+        }
+        struct sigaction action = {};
+        action.sa_handler = [](int) { watchStopRequested() = 1; };
+        sigaction(SIGINT, &action, nullptr);     // no SA_RESTART: poll() returns EINTR
+        sigaction(SIGTERM, &action, nullptr);
+
+        auto recent = fs::file_time_type::clock::now() - settle_;
+        std::vector<ImageInfo> scanned = scanImages(folder_);
+        nextId_ = (int)scanned.size();
+        for (const ImageInfo& info : scanned) {
+            std::error_code ec;
+            if (fs::last_write_time(info.path, ec) > recent) arriving_[info.filename] = { Clock::now() + settle_, true };
+            else backlog_.push_back(info);
+        }
+        backlogSize_ = (int)backlog_.size();
+        return true;
+    }
+
+    int index() const override { return 0; }
+    std::string tag() const override { return ""; }
+    bool standalone() const override { return true; }
+
+    bool claim(ImageInfo& info) override {
+        if (!backlog_.empty()) {
+            info = backlog_.front();
+            backlog_.pop_front();
+            held_++;
+            return true;
+        }
+        while (true) {
+            readEvents();
+            if (takeSettled(info)) {
+                held_++;
+                arrived_++;
+                return true;
+            }
+            // Let the batch loop run what it holds before waiting for more
+            if (held_ > 0 || watchStopRequested()) return false;
+            pollfd p = { fd_, POLLIN, 0 };
+            poll(&p, 1, waitMillis());
+        }
+    }
+
+    void finish(const ImageInfo&, int32_t) override { held_--; }
+    void recordBusy(double) override {}
+
+    int backlog() const { return backlogSize_; }
+    int arrived() const { return arrived_; }
+
+private:
+    struct Arrival {
+        Clock::time_point settlesAt;
+        bool closed;                   // written and closed, or renamed in
+    };
+
+    void readEvents() {
+        alignas(inotify_event) char buffer[16384];
+        ssize_t n;
+        while ((n = read(fd_, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + n;) {
+                const inotify_event* e = (const inotify_event*)p;
+                p += sizeof(inotify_event) + e->len;
+                if (e->len == 0 || (e->mask & IN_ISDIR)) continue;
+                std::string name = e->name;
+                if (e->mask & (IN_DELETE | IN_MOVED_FROM)) arriving_.erase(name);
+                else if (!isImageFile(name)) continue;
+                else if (e->mask & IN_MODIFY) arriving_[name] = { Clock::now() + settle_, false };
+                else if (e->mask & IN_CLOSE_WRITE) arriving_[name] = { Clock::now() + settle_, true };
+                else if (e->mask & IN_MOVED_TO) arriving_[name] = { Clock::now(), true };
+            }
+        }
+    }
+
+    // The settled file that has waited longest, if any.
+    bool takeSettled(ImageInfo& info) {
+        auto now = Clock::now();
+        auto best = arriving_.end();
+        for (auto it = arriving_.begin(); it != arriving_.end(); ++it) {
+            if (it->second.closed && it->second.settlesAt <= now && (best == arriving_.end() || it->second.settlesAt < best->second.settlesAt)) best = it;
+        }
+        if (best == arriving_.end()) return false;
+        info = ImageInfo();
+        info.filename = best->first;
+        info.path = (std::filesystem::path(folder_) / best->first).string();
+        info.id = nextId_++;
+        info.readable = stbi_info(info.path.c_str(), &info.width, &info.height, &info.channels) != 0;
+        if (info.readable) info.bytes = (size_t)info.width * info.height * info.channels;
+        arriving_.erase(best);
+        return true;
+    }
+
+    // Milliseconds until the next closed file settles, or -1 to wait for an event.
+    int waitMillis() const {
+        auto now = Clock::now();
+        int wait = -1;
+        for (const auto& a : arriving_) {
+            if (!a.second.closed) continue;
+            int millis = (int)std::ceil(std::chrono::duration<double, std::milli>(a.second.settlesAt - now).count());
+            millis = std::max(0, millis);
+            wait = wait < 0 ? millis : std::min(wait, millis);
+        }
+        return wait;
+    }
+
+    std::string folder_;
+    Clock::duration settle_;
+    int fd_ = -1;
+    std::deque<ImageInfo> backlog_;
+    std::map<std::string, Arrival> arriving_;
+    int held_ = 0;                     // claimed by the batch loop, not yet finished
+    int nextId_ = 0;                   // ids of arrivals follow the scanned files'
+    int backlogSize_ = 0, arrived_ = 0;
+};
+
+#endif // CST435_WATCH_H
@@ -0,0 +1,44 @@
+/**
+ * @file main.cpp
+ * @brief Parallel Image Processing across nodes using MPI + OpenMP
+ * @course CST435: Parallel Computing
+ *
+ * Every rank runs the shared batch loop (../src_common) on images it requests
+ * from rank 0, so the batch spreads over several VMs; see distributed.h.
+ * Build with mpicxx and -fopenmp; any backend can be selected per rank with
+ * --backend=openmp|threads|steal|serial.
+ *
+ *   mpicxx -O2 main.cpp -o main_mpi -fopenmp -std=c++17 -I../include
+ *   mpirun -np 4 ./main_mpi 2          (4 ranks x 2 threads)
+ */
+
+#include "../src_common/distributed.h"
+
+// stb_image allocates from per-thread arenas (see ../src_common/arena.h)
+#define STBI_MALLOC(sz) arenaMalloc(sz)
+#define STBI_REALLOC(p, newsz) arenaRealloc(p, newsz)
+#define STBI_REALLOC_SIZED(p, oldsz, newsz) arenaRealloc(p, newsz)
+#define STBI_FREE(p) arenaFree(p)
+
+// STB Image Libraries for loading and saving images
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../include/stb_image.h"
+#include "../include/stb_image_write.h"
+
+int main(int argc, char* argv[]) {
+    // Only the main thread of each rank calls MPI (rank 0 runs its worker on a second thread)
+    int provided = 0;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    Options opts;
+    opts.backend = "openmp";
+    opts.outputFolder = "../output/mpi";  // output folder
+
+    int code = 1;
+    if (provided < MPI_THREAD_FUNNELED) std::cout << "Error: The MPI library does not support MPI_THREAD_FUNNELED" << std::endl;
+    else if (parseOptions(argc, argv, opts)) code = runMpiBatch(opts, "MPI + OpenMP Implementation");
+
+    MPI_Finalize();
+    return code;
+}